@@ -18,13 +18,15 @@ namespace error = staticjson::error;
 template <class ValueType>
 inline void to_json_string(std::string& output, const ValueType& value)
 {
-    output = to_json_string(value);
+    output.clear();
+    staticjson::append_json(output, value);
 }
 
 template <class ValueType>
 inline void to_pretty_json_string(std::string& output, const ValueType& value)
 {
-    output = to_pretty_json_string(value);
+    output.clear();
+    staticjson::append_pretty_json(output, value);
 }
 
 template <class ValueType>
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <staticjson/staticjson.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace benchmark
+{
+struct Item
+{
+    std::uint64_t id;
+    std::string name;
+    std::string description;
+    double price;
+    bool available;
+    std::vector<int> ratings;
+    std::map<std::string, std::string> attributes;
+
+    void staticjson_init(staticjson::ObjectHandler* h)
+    {
+        h->add_property("id", &id);
+        h->add_property("name", &name);
+        h->add_property("description", &description);
+        h->add_property("price", &price);
+        h->add_property("available", &available);
+        h->add_property("ratings", &ratings);
+        h->add_property("attributes", &attributes);
+    }
+};
+
+inline std::vector<Item> make_items(size_t count)
+{
+    std::vector<Item> items(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        Item& item = items[i];
+        item.id = 1000000007ULL * i;
+        item.name = "item #" + std::to_string(i);
+        item.description = "A moderately long description of item " + std::to_string(i)
+            + ", with \"quotes\" and a\ttab.";
+        item.price = i * 1.25 + 0.01;
+        item.available = i % 3 != 0;
+        for (int j = 0; j < 8; ++j)
+            item.ratings.push_back(static_cast<int>((i * 7 + j) % 11));
+        item.attributes["color"] = i % 2 ? "red" : "blue";
+        item.attributes["size"] = std::to_string(i % 5);
+    }
+    return items;
+}
+
+// Runs `fn` repeatedly for roughly `min_seconds` and reports the throughput in MB/s, where
+// `bytes` is the amount of JSON processed by a single call.
+template <class Fn>
+double measure(const char* label, size_t bytes, Fn&& fn, double min_seconds = 1.0)
+{
+    typedef std::chrono::steady_clock clock;
+    fn();    // warm up
+    size_t iterations = 0;
+    auto start = clock::now();
+    double elapsed = 0;
+    do
+    {
+        fn();
+        ++iterations;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    } while (elapsed < min_seconds);
+    double mbps = static_cast<double>(bytes) * iterations / elapsed / (1024 * 1024);
+    std::printf("%-40s %10.1f MB/s\n", label, mbps);
+    return mbps;
+}
+}
@@ -0,0 +1,69 @@
+#include "benchmark.hpp"
+
+#include <cstdlib>
+
+namespace
+{
+struct Point
+{
+    double x, y;
+    int id;
+
+    void staticjson_init(staticjson::ObjectHandler* h)
+    {
+        h->add_property("x", &x);
+        h->add_property("y", &y);
+        h->add_property("id", &id);
+    }
+};
+
+const size_t sample_count = 20000;
+const size_t point_count = 5000;
+
+// Tag 0 grows its vectors as elements arrive, tag 1 has capacity hints and tag 2 learns the
+// sizes of previous parses
+template <int Tag>
+struct Series
+{
+    std::vector<double> samples;
+    std::vector<Point> points;
+
+    void staticjson_init(staticjson::ObjectHandler* h)
+    {
+        unsigned flags = Tag == 2 ? staticjson::Flags::LearnCapacity : staticjson::Flags::Default;
+        h->add_property("samples", &samples, flags, Tag == 1 ? sample_count : 0);
+        h->add_property("points", &points, flags, Tag == 1 ? point_count : 0);
+    }
+};
+
+template <int Tag>
+void run(const char* label, const std::string& json)
+{
+    Series<Tag> series;
+    staticjson::Handler<Series<Tag>> h(&series);
+    benchmark::measure(label, json.size(), [&] {
+        // Start from empty vectors, as when each message is decoded into a new object
+        series.samples = std::vector<double>();
+        series.points = std::vector<Point>();
+        h.prepare_for_reuse();
+        if (!staticjson::nonpublic::parse_json_string(json.c_str(), &h, nullptr))
+            std::abort();
+    });
+}
+}
+
+int main()
+{
+    Series<0> series;
+    for (size_t i = 0; i < sample_count; ++i)
+        series.samples.push_back(i * 0.125);
+    for (size_t i = 0; i < point_count; ++i)
+        series.points.push_back(Point{i * 0.5, i * -1.5, static_cast<int>(i)});
+    std::string json = staticjson::to_json_string(series);
+    std::printf("series: %zu bytes of JSON\n", json.size());
+
+    run<0>("  growing", json);
+    run<1>("  capacity hints", json);
+    run<2>("  learned capacity", json);
+    return 0;
+}
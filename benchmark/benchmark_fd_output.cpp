@@ -0,0 +1,39 @@
+#include "benchmark.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : "/tmp/staticjson_benchmark_fd_output.json";
+    auto items = benchmark::make_items(100000);
+    size_t size = staticjson::serialized_size(items);
+    std::printf("Writing %zu bytes of JSON to %s\n", size, path);
+
+    benchmark::measure("to_json_file (FILE*)", size, [&] {
+        staticjson::to_json_file(path, items);
+    });
+
+    for (size_t buffer_size : {size_t(64) << 10, size_t(1) << 20})
+    {
+        for (bool memory_mapped : {false, true})
+        {
+            staticjson::FdOutputOptions options;
+            options.buffer_size = buffer_size;
+            options.memory_mapped = memory_mapped;
+            char label[64];
+            std::snprintf(label,
+                          sizeof(label),
+                          "to_json_fd (%s, %zu KiB)",
+                          memory_mapped ? "mmap" : "write",
+                          buffer_size >> 10);
+            benchmark::measure(label, size, [&] {
+                int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+                staticjson::to_json_fd(fd, items, options);
+                ::close(fd);
+            });
+        }
+    }
+    ::unlink(path);
+    return 0;
+}
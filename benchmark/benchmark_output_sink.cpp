@@ -0,0 +1,86 @@
+#include "benchmark.hpp"
+
+#include <rapidjson/writer.h>
+
+namespace
+{
+// The serialization path used before output sinks: one std::string::push_back per character.
+struct PushBackStream
+{
+    typedef char Ch;
+
+    std::string* str;
+
+    void Put(char c) { str->push_back(c); }
+
+    void Flush() {}
+};
+
+template <class Writer>
+class WriterAdapter : public staticjson::IHandler
+{
+private:
+    Writer* w;
+
+public:
+    explicit WriterAdapter(Writer* w) : w(w) {}
+
+    bool Null() override { return w->Null(); }
+    bool Bool(bool v) override { return w->Bool(v); }
+    bool Int(int v) override { return w->Int(v); }
+    bool Uint(unsigned v) override { return w->Uint(v); }
+    bool Int64(std::int64_t v) override { return w->Int64(v); }
+    bool Uint64(std::uint64_t v) override { return w->Uint64(v); }
+    bool Double(double v) override { return w->Double(v); }
+    bool String(const char* s, staticjson::SizeType n, bool c) override
+    {
+        return w->String(s, n, c);
+    }
+    bool StartObject() override { return w->StartObject(); }
+    bool Key(const char* s, staticjson::SizeType n, bool c) override { return w->Key(s, n, c); }
+    bool EndObject(staticjson::SizeType n) override { return w->EndObject(n); }
+    bool StartArray() override { return w->StartArray(); }
+    bool EndArray(staticjson::SizeType n) override { return w->EndArray(n); }
+    void prepare_for_reuse() override {}
+};
+
+std::string push_back_serialize(const std::vector<benchmark::Item>& items)
+{
+    std::string result;
+    PushBackStream os{&result};
+    rapidjson::Writer<PushBackStream> writer(os);
+    WriterAdapter<decltype(writer)> adapter(&writer);
+    staticjson::Handler<std::vector<benchmark::Item>> h(
+        const_cast<std::vector<benchmark::Item>*>(&items));
+    h.write(&adapter);
+    return result;
+}
+}
+
+int main()
+{
+    auto items = benchmark::make_items(20000);
+    std::string json = staticjson::to_json_string(items);
+    if (json != push_back_serialize(items))
+    {
+        std::fprintf(stderr, "Mismatched output\n");
+        return 1;
+    }
+    std::printf("Serializing %zu bytes of JSON\n", json.size());
+
+    benchmark::measure("per-character push_back", json.size(), [&] {
+        std::string s = push_back_serialize(items);
+        (void)s;
+    });
+    benchmark::measure("to_json_string", json.size(), [&] {
+        std::string s = staticjson::to_json_string(items);
+        (void)s;
+    });
+    std::vector<char> buffer;
+    benchmark::measure("to_json_sink (reused std::vector<char>)", json.size(), [&] {
+        buffer.clear();
+        staticjson::VectorSink sink(&buffer);
+        staticjson::to_json_sink(&sink, items);
+    });
+    return 0;
+}
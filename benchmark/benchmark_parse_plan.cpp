@@ -0,0 +1,99 @@
+#include "benchmark.hpp"
+
+#include <cstdlib>
+
+namespace
+{
+struct Vec3
+{
+    double x, y, z;
+
+    void staticjson_init(staticjson::ObjectHandler* h)
+    {
+        h->add_property("x", &x);
+        h->add_property("y", &y);
+        h->add_property("z", &z);
+    }
+};
+
+struct Particle
+{
+    std::uint64_t id;
+    int charge;
+    bool stable;
+    std::string kind;
+    Vec3 position, velocity;
+
+    void staticjson_init(staticjson::ObjectHandler* h)
+    {
+        h->add_property("id", &id);
+        h->add_property("charge", &charge);
+        h->add_property("stable", &stable);
+        h->add_property("kind", &kind);
+        h->add_property("position", &position);
+        h->add_property("velocity", &velocity);
+    }
+};
+
+// The same types, parsed by a plan. The nested `Vec3` members are descended into by the plan
+// of `PlanParticle`.
+struct PlanItem : benchmark::Item
+{
+};
+
+struct PlanParticle : Particle
+{
+};
+}
+
+STATICJSON_DECLARE_PARSE_PLAN(PlanItem)
+STATICJSON_DECLARE_PARSE_PLAN(PlanParticle)
+
+namespace
+{
+std::vector<Particle> make_particles(size_t count)
+{
+    std::vector<Particle> particles(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        Particle& p = particles[i];
+        p.id = i * 2654435761ULL;
+        p.charge = static_cast<int>(i % 3) - 1;
+        p.stable = i % 7 != 0;
+        p.kind = i % 2 ? "muon" : "electron";
+        p.position = {i * 0.5, i * -0.25, 1.0 / (i + 1)};
+        p.velocity = {1.5, static_cast<double>(i), -2.0};
+    }
+    return particles;
+}
+
+template <class Tree, class Plan, class T>
+void compare(const char* name, const T& value)
+{
+    std::string json = staticjson::to_json_string(value);
+    std::vector<Tree> tree;
+    std::vector<Plan> plan;
+    staticjson::ParseStatus status;
+    if (!staticjson::from_json_string(json.c_str(), &plan, &status)
+        || staticjson::to_json_string(plan) != json)
+    {
+        std::fprintf(stderr, "Mismatched parse for %s\n%s", name, status.description().c_str());
+        std::exit(1);
+    }
+    std::printf("%s: %zu bytes of JSON\n", name, json.size());
+
+    benchmark::measure("  handler tree", json.size(), [&] {
+        staticjson::from_json_string(json.c_str(), &tree, nullptr);
+    });
+    benchmark::measure("  parse plan", json.size(), [&] {
+        staticjson::from_json_string(json.c_str(), &plan, nullptr);
+    });
+}
+}
+
+int main()
+{
+    compare<benchmark::Item, PlanItem>("items", benchmark::make_items(20000));
+    compare<Particle, PlanParticle>("particles", make_particles(50000));
+    return 0;
+}
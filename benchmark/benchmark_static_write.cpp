@@ -0,0 +1,62 @@
+#include "benchmark.hpp"
+
+#include <cstdlib>
+
+namespace
+{
+// Compares the type erased write path, where every token is a virtual call into an adapter around
+// the writer, with the templated one that calls the writer directly.
+template <class T>
+void compare(const char* name, const T& value)
+{
+    staticjson::Handler<T> h(const_cast<T*>(&value));
+    std::string json = staticjson::to_json_string(value);
+    if (json != staticjson::nonpublic::serialize_json_string(&h))
+    {
+        std::fprintf(stderr, "Mismatched output for %s\n", name);
+        std::exit(1);
+    }
+    std::printf("%s: %zu bytes of JSON\n", name, json.size());
+
+    std::string out;
+    out.reserve(json.size() * 2);
+    benchmark::measure("  virtual (compact)", json.size(), [&] {
+        out.clear();
+        staticjson::StringSink sink(&out);
+        staticjson::nonpublic::serialize_json_sink(&sink, &h);
+    });
+    benchmark::measure("  templated (compact)", json.size(), [&] {
+        out.clear();
+        staticjson::StringSink sink(&out);
+        staticjson::to_json_sink(&sink, value);
+    });
+    benchmark::measure("  virtual (pretty)", json.size(), [&] {
+        out.clear();
+        staticjson::StringSink sink(&out);
+        staticjson::nonpublic::serialize_pretty_json_sink(&sink, &h);
+    });
+    benchmark::measure("  templated (pretty)", json.size(), [&] {
+        out.clear();
+        staticjson::StringSink sink(&out);
+        staticjson::to_pretty_json_sink(&sink, value);
+    });
+}
+}
+
+int main()
+{
+    compare("structs", benchmark::make_items(20000));
+
+    std::vector<std::vector<int>> matrix(2000, std::vector<int>(200));
+    for (size_t i = 0; i < matrix.size(); ++i)
+        for (size_t j = 0; j < matrix[i].size(); ++j)
+            matrix[i][j] = static_cast<int>(i * j % 1000);
+    compare("std::vector<std::vector<int>>", matrix);
+
+    std::vector<std::map<std::string, bool>> flags(20000);
+    for (size_t i = 0; i < flags.size(); ++i)
+        for (int j = 0; j < 10; ++j)
+            flags[i]["flag" + std::to_string(j)] = (i + j) % 2 == 0;
+    compare("std::vector<std::map<std::string, bool>>", flags);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "../src/string_escape.hpp"
+#include "benchmark.hpp"
+
+#include <cstring>
+
+namespace
+{
+std::vector<std::string> make_corpus(const char* fragment, size_t count, size_t length)
+{
+    std::string text;
+    while (text.size() < length)
+        text += fragment;
+    text.resize(length);
+    return std::vector<std::string>(count, text);
+}
+
+size_t scan_all(const std::vector<std::string>& corpus,
+                staticjson::nonpublic::FindJsonEscapeFunction f)
+{
+    size_t found = 0;
+    for (const std::string& s : corpus)
+    {
+        const char* p = s.data();
+        const char* end = p + s.size();
+        while ((p = f(p, end)) != end)
+        {
+            ++found;
+            ++p;
+        }
+    }
+    return found;
+}
+}
+
+int main()
+{
+    using namespace staticjson::nonpublic;
+
+    struct Corpus
+    {
+        const char* name;
+        std::vector<std::string> strings;
+    };
+    Corpus corpora[] = {
+        {"ASCII", make_corpus("The quick brown fox jumps over the lazy dog. ", 2000, 2000)},
+        {"UTF-8",
+         make_corpus("Zwölf Boxkämpfer jagen Viktor quer über den Sylter Deich. 敏捷的狐狸 ",
+                     2000,
+                     2000)},
+        {"escape-heavy", make_corpus("say \"hi\"\n\ttab\\path\x01 ", 2000, 2000)},
+    };
+
+    struct Kernel
+    {
+        const char* name;
+        FindJsonEscapeFunction f;
+    };
+    Kernel kernels[] = {
+        {"scalar", &find_json_escape_scalar},
+        {"SSE2", get_find_json_escape_sse2()},
+        {"AVX2", get_find_json_escape_avx2()},
+    };
+
+    for (const Corpus& corpus : corpora)
+    {
+        size_t bytes = corpus.strings.size() * corpus.strings.front().size();
+        std::printf("== %s strings\n", corpus.name);
+        size_t expected = scan_all(corpus.strings, &find_json_escape_scalar);
+        for (const Kernel& kernel : kernels)
+        {
+            if (!kernel.f)
+            {
+                std::printf("%-40s %15s\n", kernel.name, "unsupported");
+                continue;
+            }
+            if (scan_all(corpus.strings, kernel.f) != expected)
+            {
+                std::fprintf(stderr, "Kernel %s is incorrect\n", kernel.name);
+                return 1;
+            }
+            char label[64];
+            std::snprintf(label, sizeof(label), "scan (%s)", kernel.name);
+            benchmark::measure(label, bytes, [&] { scan_all(corpus.strings, kernel.f); });
+        }
+        std::string out;
+        benchmark::measure("append_json (selected kernel)", bytes, [&] {
+            out.clear();
+            staticjson::append_json(out, corpus.strings);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace staticjson
+{
+class Arena;
+class ParseStatus;
+struct MemoryUsage;
+
+namespace mempool
+{
+    // The base allocator of the memory pools of handlers. It takes chunks from an `Arena` if one
+    // was active when the pool was created, and from the heap otherwise. Handlers built while a
+    // `MemoryAccountScope` is active get an accounted allocator, whose chunks carry their size so
+    // that they are charged to the scope while held; other chunks are taken as they are.
+    class ChunkAllocator
+    {
+    private:
+        Arena* arena;
+        bool accounted;
+
+    public:
+        static const bool kNeedFree = true;
+
+        explicit ChunkAllocator(Arena* arena = nullptr, bool accounted = false) noexcept
+            : arena(arena), accounted(accounted)
+        {
+        }
+
+        void* Malloc(std::size_t size);
+        void* Realloc(void* ptr, std::size_t old_size, std::size_t new_size);
+        void Free(void* ptr) noexcept;
+
+        bool operator==(const ChunkAllocator& other) const noexcept
+        {
+            return arena == other.arena && accounted == other.accounted;
+        }
+        bool operator!=(const ChunkAllocator& other) const noexcept { return !(*this == other); }
+    };
+
+    // The allocator for memory pools created now, which depends on the active `ArenaScope` or
+    // `ChunkAllocatorScope`
+    ChunkAllocator* current_chunk_allocator() noexcept;
+
+    // Makes `chunks` the allocator for memory pools created on this thread during its lifetime,
+    // whatever arena is active. Handlers that create their children lazily put one around the
+    // creation with the allocator they were built with, so that a handler tree draws from one
+    // arena even when it is used under the scope of another.
+    class ChunkAllocatorScope
+    {
+    private:
+        ChunkAllocator* previous;
+
+    public:
+        explicit ChunkAllocatorScope(ChunkAllocator* chunks) noexcept;
+        ChunkAllocatorScope(const ChunkAllocatorScope&) = delete;
+        ChunkAllocatorScope& operator=(const ChunkAllocatorScope&) = delete;
+        ~ChunkAllocatorScope();
+    };
+}
+
+struct ArenaOptions
+{
+    // Size of the blocks reserved from the system. Requests larger than a quarter of this go to
+    // the heap directly.
+    std::size_t block_size = 64 * 1024;
+    // Back blocks with huge pages where the system supports it. Blocks are then rounded up to
+    // the huge page size.
+    bool huge_pages = false;
+};
+
+// Supplies the chunks of the memory pools of all handlers created while it is active (see
+// `ArenaScope`). Freed chunks are kept for reuse, and `reset` makes all memory available again
+// without returning it to the system. Not thread safe.
+class Arena
+{
+private:
+    struct Block
+    {
+        char* data;
+        std::size_t size;
+        bool mapped;
+    };
+
+    ArenaOptions options;
+    std::vector<Block> blocks;
+    // Heads of the free lists, one per power of two size class
+    std::vector<void*> free_lists;
+    std::size_t current_block = 0;
+    std::size_t current_offset = 0;
+    std::size_t outstanding = 0;
+    mempool::ChunkAllocator chunks;
+    mempool::ChunkAllocator accounted_chunks;
+
+    void add_block();
+
+public:
+    explicit Arena(const ArenaOptions& options = ArenaOptions());
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena();
+
+    void* allocate(std::size_t size);
+    void deallocate(void* ptr) noexcept;
+
+    // Does nothing while chunks are still in use.
+    void reset() noexcept;
+
+    // Bytes reserved from the system in blocks
+    std::size_t capacity() const noexcept;
+
+    // Number of chunks currently in use
+    std::size_t in_use() const noexcept { return outstanding; }
+
+    mempool::ChunkAllocator* chunk_allocator(bool accounted = false) noexcept
+    {
+        return accounted ? &accounted_chunks : &chunks;
+    }
+};
+
+// Makes `arena` the source of memory for handlers created on this thread during its lifetime.
+// Handlers created in the scope must be destroyed before the arena.
+class ArenaScope
+{
+private:
+    Arena* previous;
+
+public:
+    explicit ArenaScope(Arena* arena) noexcept;
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+    ~ArenaScope();
+
+    static Arena* current() noexcept;
+};
+
+// Holds copies of strings for `StringSlice` and `std::string_view` fields, when they cannot point
+// into the input (see `StringArenaScope`). The copies live until `clear` or destruction.
+class StringArena
+{
+private:
+    struct Block
+    {
+        char* data;
+        std::size_t size;
+    };
+
+    std::vector<Block> blocks;
+    std::size_t block_size;
+    std::size_t current_block = 0;
+    std::size_t current_offset = 0;
+
+public:
+    explicit StringArena(std::size_t block_size = 4096) : block_size(block_size) {}
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+    ~StringArena();
+
+    // Returns a null terminated copy of `str`
+    const char* store(const char* str, std::size_t length);
+
+    // Invalidates all copies, keeping the memory for new ones
+    void clear() noexcept;
+
+    std::size_t capacity() const noexcept;
+};
+
+// Makes `arena` the home of strings copied for view fields parsed on this thread during its
+// lifetime.
+class StringArenaScope
+{
+private:
+    StringArena* previous;
+
+public:
+    explicit StringArenaScope(StringArena* arena) noexcept;
+    StringArenaScope(const StringArenaScope&) = delete;
+    StringArenaScope& operator=(const StringArenaScope&) = delete;
+    ~StringArenaScope();
+
+    static StringArena* current() noexcept;
+};
+
+namespace nonpublic
+{
+    // Placed in the top level functions. Unless an arena is already active, activates a per
+    // thread arena for the duration of the call, and resets it afterwards for the next one.
+    class RootArenaScope
+    {
+    private:
+        Arena* arena;
+
+    public:
+        RootArenaScope();
+        RootArenaScope(const RootArenaScope&) = delete;
+        RootArenaScope& operator=(const RootArenaScope&) = delete;
+        ~RootArenaScope();
+    };
+
+    // Placed in the top level parsing functions, before the handlers are created. Counts the
+    // memory taken on this thread into the `MemoryUsage` of `status`, if any, and holds it to
+    // the budget set there.
+    class MemoryAccountScope
+    {
+    private:
+        MemoryUsage* usage;
+        std::size_t budget;
+        std::size_t held = 0;
+        // Set by the first charge over the budget and kept for the rest of the parse, as the
+        // takers of chunks cannot fail by themselves
+        bool exceeded = false;
+        MemoryAccountScope* previous;
+
+        friend bool charge_memory(std::size_t bytes) noexcept;
+        friend void release_memory(std::size_t bytes) noexcept;
+
+    public:
+        explicit MemoryAccountScope(ParseStatus* status) noexcept;
+        MemoryAccountScope(const MemoryAccountScope&) = delete;
+        MemoryAccountScope& operator=(const MemoryAccountScope&) = delete;
+        ~MemoryAccountScope();
+
+        bool over_budget() const noexcept { return exceeded; }
+    };
+
+    // The scope that memory taken on this thread is counted against, or null
+    const MemoryAccountScope* active_memory_account() noexcept;
+
+    // Counts `bytes` taken against the active `MemoryAccountScope`, if any. False once the budget
+    // is exceeded.
+    bool charge_memory(std::size_t bytes) noexcept;
+
+    void release_memory(std::size_t bytes) noexcept;
+}
+}
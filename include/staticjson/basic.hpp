@@ -1,15 +1,21 @@
 #pragma once
 
 #include <rapidjson/document.h>
+#include <staticjson/arena.hpp>
 #include <staticjson/error.hpp>
+#include <staticjson/writer.hpp>
 
 #include <climits>
 #include <cstddef>
 #include <cstdint>
+#include <exception>
 #include <map>
 #include <memory>
+#include <new>
 #include <stack>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 namespace staticjson
 {
@@ -31,7 +37,17 @@ class GlobalConfig : private NonMobile
 public:
     static GlobalConfig* getInstance() noexcept;
     SizeType getMemoryChunkSize() const noexcept { return memoryChunkSize; }
+    // Most digits written after the decimal point of floating point numbers; the rest are
+    // truncated. Takes effect for writers created afterwards.
+    int getMaxDecimalPlaces() const noexcept { return maxDecimalPlaces; }
+    void setMaxDecimalPlaces(int places) noexcept { maxDecimalPlaces = places; }
     void setMemoryChunkSize(SizeType value) noexcept { memoryChunkSize = value; }
+    // Options of the per thread arenas used by top level functions. Takes effect for threads
+    // that have not called them yet.
+    const ArenaOptions& getArenaOptions() const noexcept { return arenaOptions; }
+    void setArenaOptions(const ArenaOptions& options) noexcept { arenaOptions = options; }
+    bool isRootArenaEnabled() const noexcept { return rootArenaEnabled; }
+    void setRootArenaEnabled(bool enabled) noexcept { rootArenaEnabled = enabled; }
     void setMaxLeaves(SizeType maxNum) noexcept
     {
         maxLeaves = maxNum;
@@ -64,6 +80,9 @@ private:
     SizeType maxLeaves = UINT_MAX;
     SizeType maxDepth = UINT_MAX;
     SizeType memoryChunkSize = 1000;
+    int maxDecimalPlaces = 324;
+    ArenaOptions arenaOptions;
+    bool rootArenaEnabled = true;
 };
 
 class IHandler
@@ -87,6 +106,10 @@ public:
 
     virtual bool Double(double) = 0;
 
+    // A number that was a `float` before it was written. Writers print the shortest form that
+    // reads back as the same float; the default implementation forwards to `Double`.
+    virtual bool Float(float);
+
     virtual bool String(const char*, SizeType, bool) = 0;
 
     virtual bool StartObject() = 0;
@@ -101,14 +124,151 @@ public:
 
     virtual bool RawNumber(const char*, SizeType, bool);
 
+    // An object key together with its escaped and quoted JSON form, so that writers can copy the
+    // latter verbatim. The default implementation forwards to `Key`.
+    virtual bool QuotedKey(const char* str,
+                           SizeType length,
+                           const char* quoted,
+                           SizeType quoted_length);
+
     virtual void prepare_for_reuse() = 0;
 };
 
+namespace nonpublic
+{
+    // Presents a rapidjson style writer as an `IHandler`.
+    template <class T>
+    class IHandlerAdapter : public IHandler
+    {
+    private:
+        T* t;
+
+    public:
+        explicit IHandlerAdapter(T* t) : t(t) {}
+
+        virtual bool Null() override { return t->Null(); }
+
+        virtual bool Bool(bool v) override { return t->Bool(v); }
+
+        virtual bool Int(int v) override { return t->Int(v); }
+
+        virtual bool Uint(unsigned v) override { return t->Uint(v); }
+
+        virtual bool Int64(std::int64_t v) override { return t->Int64(v); }
+
+        virtual bool Uint64(std::uint64_t v) override { return t->Uint64(v); }
+
+        virtual bool Double(double v) override { return t->Double(v); }
+
+        virtual bool Float(float v) override { return write_float(*t, v); }
+
+        virtual bool String(const char* str, SizeType sz, bool copy) override
+        {
+            return t->String(str, sz, copy);
+        }
+
+        virtual bool StartObject() override { return t->StartObject(); }
+
+        virtual bool Key(const char* str, SizeType sz, bool copy) override
+        {
+            return t->Key(str, sz, copy);
+        }
+
+        virtual bool EndObject(SizeType sz) override { return t->EndObject(sz); }
+
+        virtual bool
+        QuotedKey(const char*, SizeType, const char* quoted, SizeType quoted_length) override
+        {
+            return t->RawValue(quoted, quoted_length, rapidjson::kStringType);
+        }
+
+        virtual bool StartArray() override { return t->StartArray(); }
+
+        virtual bool EndArray(SizeType sz) override { return t->EndArray(sz); }
+
+        virtual void prepare_for_reuse() override { std::terminate(); }
+    };
+
+    // Presents an `IHandler` as a rapidjson style writer, the reverse of `IHandlerAdapter`, so
+    // that the virtual `write` of a handler shares the body of its `write_to`.
+    class IHandlerWriter
+    {
+    private:
+        IHandler* out;
+
+    public:
+        explicit IHandlerWriter(IHandler* out) : out(out) {}
+
+        IHandler* handler() const { return out; }
+
+        bool Null() { return out->Null(); }
+        bool Bool(bool v) { return out->Bool(v); }
+        bool Int(int v) { return out->Int(v); }
+        bool Uint(unsigned v) { return out->Uint(v); }
+        bool Int64(std::int64_t v) { return out->Int64(v); }
+        bool Uint64(std::uint64_t v) { return out->Uint64(v); }
+        bool Double(double v) { return out->Double(v); }
+        bool Float(float v) { return out->Float(v); }
+        bool String(const char* str, SizeType length, bool copy = false)
+        {
+            return out->String(str, length, copy);
+        }
+        bool StartObject() { return out->StartObject(); }
+        bool Key(const char* str, SizeType length, bool copy = false)
+        {
+            return out->Key(str, length, copy);
+        }
+        bool EndObject(SizeType count = 0) { return out->EndObject(count); }
+        bool StartArray() { return out->StartArray(); }
+        bool EndArray(SizeType count = 0) { return out->EndArray(count); }
+    };
+
+    // Writes an object key whose escaped and quoted form is known, verbatim where the writer
+    // allows it
+    template <class Writer>
+    inline bool write_quoted_key(
+        Writer& w, const char*, SizeType, const char* quoted, SizeType quoted_length)
+    {
+        return w.RawValue(quoted, quoted_length, rapidjson::kStringType);
+    }
+
+    inline bool write_quoted_key(IHandlerWriter& w,
+                                 const char* str,
+                                 SizeType length,
+                                 const char* quoted,
+                                 SizeType quoted_length)
+    {
+        return w.handler()->QuotedKey(str, length, quoted, quoted_length);
+    }
+}
+
 using rapidjson::Document;
 using rapidjson::Value;
 
 typedef rapidjson::MemoryPoolAllocator<> MemoryPoolAllocator;
 
+// One part of a handler tree, as reported by `handler_footprint`
+struct FootprintNode
+{
+    // What the part is for, such as the name of a field
+    std::string name;
+    // The type parsed by the part, for handlers
+    std::string type;
+    // Memory of this part alone, not counting its children. Standard containers are estimated.
+    std::size_t bytes = 0;
+    std::size_t objects = 0;
+    std::vector<FootprintNode> children;
+
+    // Adds a part held outside of this one
+    FootprintNode& add(std::string name, std::size_t bytes, std::size_t objects = 1);
+
+    // Moves `bytes` of this part, held inline, to a child
+    FootprintNode& split(std::string name, std::size_t bytes);
+
+    std::size_t total_bytes() const;
+    std::size_t total_objects() const;
+};
+
 class BaseHandler : public IHandler, private NonMobile
 {
     friend class NullableHandler;
@@ -120,6 +280,8 @@ protected:
 protected:
     bool set_out_of_range(const char* actual_type);
     bool set_type_mismatch(const char* actual_type);
+    // Counts `bytes` taken by the parsed value, failing once the memory budget is exceeded
+    bool charge_memory(std::size_t bytes);
 
     virtual void reset() {}
 
@@ -130,6 +292,10 @@ public:
 
     virtual std::string type_name() const = 0;
 
+    // Builds the same name as `type_name` without this handler, so that errors can put it off
+    // until they are described. Null when the name depends on the state of this handler.
+    virtual nonpublic::TypeNameRenderer type_name_renderer() const { return nullptr; }
+
     virtual bool Null() override { return set_type_mismatch("null"); }
 
     virtual bool Bool(bool) override { return set_type_mismatch("bool"); }
@@ -161,6 +327,11 @@ public:
 
     virtual bool has_error() const { return bool(the_error); }
 
+    // Sets the number of elements reserved before a container is parsed. With `learn`, the size
+    // parsed last time is reserved as well, for handlers that are reused. Ignored by handlers of
+    // other types.
+    virtual void set_capacity_hint(std::size_t, bool) {}
+
     virtual bool reap_error(ErrorStack& errs)
     {
         if (!the_error)
@@ -180,13 +351,87 @@ public:
 
     virtual bool write(IHandler* output) const = 0;
 
+    // Writes to a concrete writer type. Handlers that know the exact types of their children
+    // hide this with a version that calls the writer and the children directly; this fallback
+    // goes through the virtual `write`. Call it through `nonpublic::write_static`, which only
+    // picks a hiding version when no more derived class overrides `write`.
+    template <class Writer>
+    bool write_to(Writer& w) const;
+
     virtual void generate_schema(Value& output, MemoryPoolAllocator& alloc) const = 0;
+
+    // Adds the parts of this handler to `node`, whose bytes start as the size of the handler
+    virtual void describe_footprint(FootprintNode&) const {}
 };
 
+namespace nonpublic
+{
+    // Names `node` after the type of `h` and fills in its parts
+    void describe_handler(FootprintNode& node, const BaseHandler& h);
+
+    template <class MemberPointer>
+    struct member_class;
+
+    template <class Class, class Member>
+    struct member_class<Member Class::*>
+    {
+        typedef Class type;
+    };
+
+    // Writes `h` through its virtual `write`
+    template <class Writer>
+    inline bool write_virtual(const BaseHandler& h, Writer& w)
+    {
+        IHandlerAdapter<Writer> adapter(&w);
+        return h.write(&adapter);
+    }
+
+    inline bool write_virtual(const BaseHandler& h, IHandlerWriter& w)
+    {
+        return h.write(w.handler());
+    }
+}
+
+template <class Writer>
+inline bool BaseHandler::write_to(Writer& w) const
+{
+    return nonpublic::write_virtual(*this, w);
+}
+
+namespace nonpublic
+{
+    template <class H, class Writer>
+    inline bool write_static(const H& h, Writer& w, std::true_type)
+    {
+        return h.write_to(w);
+    }
+
+    template <class H, class Writer>
+    inline bool write_static(const H& h, Writer& w, std::false_type)
+    {
+        return write_virtual(h, w);
+    }
+
+    template <class H, class Writer>
+    inline bool write_static(const H& h, Writer& w)
+    {
+        typedef typename member_class<decltype(&H::write)>::type write_class;
+        typedef typename member_class<decltype(&H::template write_to<Writer>)>::type
+            write_to_class;
+        return write_static(h, w, std::is_same<write_class, write_to_class>());
+    }
+
+    template <class H, class Writer>
+    bool write_erased(const BaseHandler* h, Writer& w)
+    {
+        return write_static(*static_cast<const H*>(h), w);
+    }
+}
+
 struct Flags
 {
     static const unsigned Default = 0x0, AllowDuplicateKey = 0x1, Optional = 0x2, IgnoreRead = 0x4,
-                          IgnoreWrite = 0x8, DisallowUnknownKey = 0x10;
+                          IgnoreWrite = 0x8, DisallowUnknownKey = 0x10, LearnCapacity = 0x20;
 };
 
 // Forward declaration
@@ -196,13 +441,15 @@ class Handler;
 namespace mempool
 {
     [[noreturn]] void throw_bad_alloc();
-    rapidjson::CrtAllocator& get_crt_allocator() noexcept;
+
+    // Chunks come from the arena active at construction, if any
+    typedef rapidjson::MemoryPoolAllocator<ChunkAllocator> Pool;
 
     template <class T>
     class PooledAllocator
     {
     private:
-        MemoryPoolAllocator* pool;
+        Pool* pool;
 
         template <class U>
         friend class PooledAllocator;
@@ -213,7 +460,7 @@ namespace mempool
         using propagate_on_container_move_assignment = std::true_type;
         using propagate_on_container_swap = std::true_type;
 
-        explicit PooledAllocator(MemoryPoolAllocator* pool) noexcept : pool(pool) {}
+        explicit PooledAllocator(Pool* pool) noexcept : pool(pool) {}
 
         template <class U>
         PooledAllocator(const PooledAllocator<U>& other) noexcept : pool(other.pool)
@@ -271,8 +518,7 @@ namespace mempool
                 return;
             }
             ptr->~T();
-            static_assert(!MemoryPoolAllocator::kNeedFree,
-                          "MemoryPoolAllocator must not need freeing");
+            static_assert(!Pool::kNeedFree, "Pool must not need freeing");
         }
     };
 
@@ -280,28 +526,181 @@ namespace mempool
     using UniquePtr = std::unique_ptr<T, PooledDeleter<T>>;
 
     template <typename T, typename... Args>
-    T* pooled_new(MemoryPoolAllocator& pool, Args&&... args)
+    T* pooled_new(Pool& pool, Args&&... args)
     {
         auto storage = pool.Malloc(sizeof(T));
-        static_assert(!MemoryPoolAllocator::kNeedFree,
-                      "MemoryPoolAllocator must not need freeing or we will need to handle "
+        static_assert(!Pool::kNeedFree,
+                      "Pool must not need freeing or we will need to handle "
                       "potential exceptions in the construction of T");
         new (storage) T(std::forward<Args>(args)...);
         return static_cast<T*>(storage);
     }
+
+    // Deleter of objects made by `chunk_new`, which returns their memory to the allocator that
+    // supplied it
+    template <class T>
+    struct ChunkDeleter
+    {
+        ChunkAllocator* chunks;
+
+        explicit ChunkDeleter(ChunkAllocator* chunks = nullptr) noexcept : chunks(chunks) {}
+
+        void operator()(T* ptr) const noexcept
+        {
+            if (!ptr)
+            {
+                return;
+            }
+            ptr->~T();
+            chunks->Free(ptr);
+        }
+    };
+
+    template <class T>
+    using ChunkPtr = std::unique_ptr<T, ChunkDeleter<T>>;
+
+    // Allocates from `current_chunk_allocator()`, so that objects created and destroyed repeatedly
+    // during a call keep reusing the same memory.
+    template <typename T, typename... Args>
+    ChunkPtr<T> chunk_new(Args&&... args)
+    {
+        ChunkAllocator* chunks = current_chunk_allocator();
+        void* storage = chunks->Malloc(sizeof(T));
+        if (!storage)
+        {
+            throw_bad_alloc();
+        }
+        try
+        {
+            new (storage) T(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            chunks->Free(storage);
+            throw;
+        }
+        return ChunkPtr<T>(static_cast<T*>(storage), ChunkDeleter<T>(chunks));
+    }
+}
+
+class ObjectHandler;
+
+template <class T>
+class PlanHandler;
+
+namespace nonpublic
+{
+    class ParsePlan;
+
+    // Compiles the fields registered on `h` into a parse plan. Returns null unless every field
+    // lies within the `size` bytes at `base`, as otherwise the plan would not fit other instances.
+    ParsePlan* compile_parse_plan(const ObjectHandler& h, const void* base, std::size_t size);
+
+    struct ParsePlanDeleter
+    {
+        void operator()(ParsePlan* plan) const noexcept;
+    };
+
+    // What a parse plan needs to know about the type of a field, recorded by `add_property`.
+    struct FieldOps
+    {
+        // Types that the plan reads and writes itself. Everything else goes through a handler.
+        enum Opcode : unsigned char
+        {
+            OP_HANDLER,
+            OP_BOOL,
+            OP_INT,
+            OP_UINT,
+            OP_INT64,
+            OP_UINT64,
+            OP_DOUBLE,
+            OP_STRING,
+            OP_OBJECT
+        };
+
+        Opcode opcode;
+        std::size_t handler_size;
+        BaseHandler* (*construct)(void* storage, void* field);
+        // The nested plan of an OP_OBJECT field
+        const ParsePlan* (*sub_plan)(void* field);
+        bool (*write_compact)(const BaseHandler* h, CompactSinkWriter& w);
+        bool (*write_pretty)(const BaseHandler* h, PrettySinkWriter& w);
+    };
+
+    template <class T>
+    const FieldOps* get_field_ops();
+
+    // Storage for one field handler at a time
+    class HandlerStorage : private NonMobile
+    {
+    private:
+        static const std::size_t inline_size = 256;
+        alignas(std::max_align_t) char inline_storage[inline_size];
+        std::unique_ptr<std::max_align_t[]> heap_storage;
+        void* storage;
+
+    public:
+        explicit HandlerStorage(std::size_t size)
+        {
+            if (size <= inline_size)
+            {
+                storage = inline_storage;
+            }
+            else
+            {
+                heap_storage.reset(
+                    new std::max_align_t[(size + sizeof(std::max_align_t) - 1)
+                                         / sizeof(std::max_align_t)]);
+                storage = heap_storage.get();
+            }
+        }
+
+        void* get() const { return storage; }
+    };
+
+    // The handler of a field, constructed in `storage` for the duration of a scope
+    class ScopedFieldHandler : private NonMobile
+    {
+    private:
+        BaseHandler* h;
+
+    public:
+        explicit ScopedFieldHandler(const FieldOps* ops, void* field, void* storage)
+            : h(ops->construct(storage, field))
+        {
+        }
+
+        ~ScopedFieldHandler() { h->~BaseHandler(); }
+
+        BaseHandler* get() const { return h; }
+    };
 }
 
 class ObjectHandler : public BaseHandler
 {
+    friend nonpublic::ParsePlan*
+    nonpublic::compile_parse_plan(const ObjectHandler& h, const void* base, std::size_t size);
+
 protected:
     struct FlaggedHandler
     {
-        mempool::UniquePtr<BaseHandler> handler;
+        // Created when the key is first seen, or when the field is written
+        mutable mempool::UniquePtr<BaseHandler> handler;
         unsigned flags;
+        // The name as a JSON string, allocated from the memory pool
+        const char* quoted_name = nullptr;
+        SizeType quoted_name_length = 0;
+        // The registered member and its type
+        void* field = nullptr;
+        const nonpublic::FieldOps* ops = nullptr;
+        std::size_t capacity_hint = 0;
     };
 
 protected:
-    MemoryPoolAllocator memory_pool_allocator;
+    // Taken when this handler is built, and used for the handlers of its fields as well
+    mempool::ChunkAllocator* chunks;
+    // Mutable so that handlers can be created on write
+    mutable mempool::Pool memory_pool_allocator;
     mempool::Map<mempool::String, FlaggedHandler> internals;
     FlaggedHandler* current = nullptr;
     mempool::String current_name;
@@ -320,18 +719,44 @@ protected:
     bool postcheck(bool success);
     void set_missing_required(const std::string& name);
     void add_handler(mempool::String&&, FlaggedHandler&&);
+    BaseHandler* get_handler(const FlaggedHandler& fh) const
+    {
+        return fh.handler ? fh.handler.get() : create_handler(fh);
+    }
+    BaseHandler* create_handler(const FlaggedHandler& fh) const;
     void reset() override;
 
+    bool write_field(const FlaggedHandler& fh, nonpublic::CompactSinkWriter& w) const
+    {
+        return fh.ops->write_compact(get_handler(fh), w);
+    }
+
+    bool write_field(const FlaggedHandler& fh, nonpublic::PrettySinkWriter& w) const
+    {
+        return fh.ops->write_pretty(get_handler(fh), w);
+    }
+
+    template <class Writer>
+    bool write_field(const FlaggedHandler& fh, Writer& w) const
+    {
+        return nonpublic::write_virtual(*get_handler(fh), w);
+    }
+
 private:
     bool StartCheckMaxDepthMaxLeaves(bool isArray);
     bool EndCheckMaxDepthMaxLeaves(SizeType sz, bool isArray);
 
     template <class T>
-    void add_property(mempool::String name, T* pointer, unsigned flags_ = Flags::Default)
+    void add_property(mempool::String name,
+                      T* pointer,
+                      unsigned flags_ = Flags::Default,
+                      std::size_t capacity_hint = 0)
     {
         FlaggedHandler fh;
-        fh.handler.reset(mempool::pooled_new<Handler<T>>(memory_pool_allocator, pointer));
         fh.flags = flags_;
+        fh.field = pointer;
+        fh.ops = nonpublic::get_field_ops<T>();
+        fh.capacity_hint = capacity_hint;
         add_handler(std::move(name), std::move(fh));
     }
 
@@ -342,6 +767,8 @@ public:
 
     std::string type_name() const override;
 
+    void describe_footprint(FootprintNode& node) const override;
+
     virtual bool Null() override;
 
     virtual bool Bool(bool) override;
@@ -372,30 +799,65 @@ public:
 
     virtual bool write(IHandler* output) const override;
 
+    template <class Writer>
+    bool write_to(Writer& w) const
+    {
+        SizeType count = 0;
+        if (!w.StartObject())
+            return false;
+
+        for (auto&& pair : internals)
+        {
+            const FlaggedHandler& fh = pair.second;
+            if (fh.flags & Flags::IgnoreWrite)
+                continue;
+            if (!nonpublic::write_quoted_key(w,
+                                             pair.first.data(),
+                                             static_cast<SizeType>(pair.first.size()),
+                                             fh.quoted_name,
+                                             fh.quoted_name_length))
+                return false;
+            if (!write_field(fh, w))
+                return false;
+            ++count;
+        }
+        return w.EndObject(count);
+    }
+
     virtual void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override;
 
     unsigned get_flags() const { return flags; }
 
     void set_flags(unsigned f) { flags = f; }
 
-    const MemoryPoolAllocator& get_memory_pool() const noexcept { return memory_pool_allocator; }
+    const mempool::Pool& get_memory_pool() const noexcept { return memory_pool_allocator; }
 
+    // `capacity_hint` is the number of elements to reserve when the field is a container (see
+    // `BaseHandler::set_capacity_hint`)
     template <class T>
-    void add_property(const std::string& name, T* pointer, unsigned flags_ = Flags::Default)
+    void add_property(const std::string& name,
+                      T* pointer,
+                      unsigned flags_ = Flags::Default,
+                      std::size_t capacity_hint = 0)
     {
         add_property(mempool::String(name.data(),
                                      name.size(),
                                      mempool::String::allocator_type(&memory_pool_allocator)),
                      pointer,
-                     flags_);
+                     flags_,
+                     capacity_hint);
     }
 
     template <class T>
-    void add_property(const char* name, T* pointer, unsigned flags_ = Flags::Default)
+    void add_property(const char* name,
+                      T* pointer,
+                      unsigned flags_ = Flags::Default,
+                      std::size_t capacity_hint = 0)
     {
         add_property(mempool::String(name, mempool::String::allocator_type(&memory_pool_allocator)),
                      pointer,
-                     flags_);
+                     flags_,
+                     capacity_hint);
     }
 };
 
@@ -486,37 +948,66 @@ public:
         return internal.type_name();
     }
 
-    virtual bool Null() override { return postprocess(internal.Null()); }
+    nonpublic::TypeNameRenderer type_name_renderer() const override
+    {
+        return internal.type_name_renderer();
+    }
 
-    virtual bool Bool(bool b) override { return postprocess(internal.Bool(b)); }
+    void describe_footprint(FootprintNode& node) const override
+    {
+        node.split("shadow", sizeof(shadow_type));
+        nonpublic::describe_handler(node.split("shadow handler", sizeof(internal_type)), internal);
+    }
+
+    virtual bool Null() override { return postprocess(internal.internal_type::Null()); }
 
-    virtual bool Int(int i) override { return postprocess(internal.Int(i)); }
+    virtual bool Bool(bool b) override { return postprocess(internal.internal_type::Bool(b)); }
 
-    virtual bool Uint(unsigned u) override { return postprocess(internal.Uint(u)); }
+    virtual bool Int(int i) override { return postprocess(internal.internal_type::Int(i)); }
 
-    virtual bool Int64(std::int64_t i) override { return postprocess(internal.Int64(i)); }
+    virtual bool Uint(unsigned u) override { return postprocess(internal.internal_type::Uint(u)); }
 
-    virtual bool Uint64(std::uint64_t u) override { return postprocess(internal.Uint64(u)); }
+    virtual bool Int64(std::int64_t i) override
+    {
+        return postprocess(internal.internal_type::Int64(i));
+    }
 
-    virtual bool Double(double d) override { return postprocess(internal.Double(d)); }
+    virtual bool Uint64(std::uint64_t u) override
+    {
+        return postprocess(internal.internal_type::Uint64(u));
+    }
+
+    virtual bool Double(double d) override
+    {
+        return postprocess(internal.internal_type::Double(d));
+    }
 
     virtual bool String(const char* str, SizeType size, bool copy) override
     {
-        return postprocess(internal.String(str, size, copy));
+        return postprocess(internal.internal_type::String(str, size, copy));
     }
 
-    virtual bool StartObject() override { return postprocess(internal.StartObject()); }
+    virtual bool StartObject() override
+    {
+        return postprocess(internal.internal_type::StartObject());
+    }
 
     virtual bool Key(const char* str, SizeType size, bool copy) override
     {
-        return postprocess(internal.Key(str, size, copy));
+        return postprocess(internal.internal_type::Key(str, size, copy));
     }
 
-    virtual bool EndObject(SizeType sz) override { return postprocess(internal.EndObject(sz)); }
+    virtual bool EndObject(SizeType sz) override
+    {
+        return postprocess(internal.internal_type::EndObject(sz));
+    }
 
-    virtual bool StartArray() override { return postprocess(internal.StartArray()); }
+    virtual bool StartArray() override { return postprocess(internal.internal_type::StartArray()); }
 
-    virtual bool EndArray(SizeType sz) override { return postprocess(internal.EndArray(sz)); }
+    virtual bool EndArray(SizeType sz) override
+    {
+        return postprocess(internal.internal_type::EndArray(sz));
+    }
 
     virtual bool has_error() const override
     {
@@ -529,9 +1020,16 @@ public:
     }
 
     virtual bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
     {
         Converter<T>::to_shadow(*m_value, const_cast<shadow_type&>(shadow));
-        return internal.write(output);
+        return nonpublic::write_static(internal, w);
     }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
@@ -568,4 +1066,121 @@ public:
         base_type;
     explicit Handler(T* t) : base_type(t) {}
 };
+
+namespace nonpublic
+{
+    // Structs registered with `staticjson_init` or `init`, whose fields a plan can descend into
+    template <class T>
+    struct is_registered_object
+        : std::integral_constant<
+              bool,
+              std::is_base_of<helper::DispatchHandler<T, true>, Handler<T>>::value
+                  || std::is_base_of<PlanHandler<T>, Handler<T>>::value>
+    {
+    };
+
+    template <class T>
+    struct field_opcode
+        : std::integral_constant<FieldOps::Opcode,
+                                 is_registered_object<T>::value ? FieldOps::OP_OBJECT
+                                                                : FieldOps::OP_HANDLER>
+    {
+    };
+
+#define STATICJSON_FIELD_OPCODE(type, opcode)                                                      \
+    template <>                                                                                    \
+    struct field_opcode<type> : std::integral_constant<FieldOps::Opcode, FieldOps::opcode>         \
+    {                                                                                              \
+    };
+
+    STATICJSON_FIELD_OPCODE(bool, OP_BOOL)
+    STATICJSON_FIELD_OPCODE(int, OP_INT)
+    STATICJSON_FIELD_OPCODE(unsigned, OP_UINT)
+    STATICJSON_FIELD_OPCODE(std::int64_t, OP_INT64)
+    STATICJSON_FIELD_OPCODE(std::uint64_t, OP_UINT64)
+    STATICJSON_FIELD_OPCODE(double, OP_DOUBLE)
+    STATICJSON_FIELD_OPCODE(std::string, OP_STRING)
+
+#undef STATICJSON_FIELD_OPCODE
+
+    template <class T>
+    std::string render_type_name()
+    {
+        T value;
+        Handler<T> h(&value);
+        return h.type_name();
+    }
+
+    template <class T>
+    TypeNameRenderer type_name_renderer_of(std::true_type) noexcept
+    {
+        return &render_type_name<T>;
+    }
+
+    template <class T>
+    TypeNameRenderer type_name_renderer_of(std::false_type) noexcept
+    {
+        return nullptr;
+    }
+
+    // Renders the name of `T` from a handler of a fresh value, when `T` has one
+    template <class T>
+    TypeNameRenderer type_name_renderer_of() noexcept
+    {
+        return type_name_renderer_of<T>(std::is_default_constructible<T>());
+    }
+
+    template <class T>
+    BaseHandler* construct_field_handler(void* storage, void* field)
+    {
+        return new (storage) Handler<T>(static_cast<T*>(field));
+    }
+
+    template <class T>
+    ParsePlan* compile_object_plan(T* sample)
+    {
+        ObjectTypeHandler<T> h(sample);
+        return compile_parse_plan(h, sample, sizeof(T));
+    }
+
+    // Compiled once per type from the first instance seen, and immutable afterwards
+    template <class T>
+    const ParsePlan* parse_plan_of(T* sample)
+    {
+        static const std::unique_ptr<ParsePlan, ParsePlanDeleter> plan(compile_object_plan(sample));
+        return plan.get();
+    }
+
+    template <class T>
+    const ParsePlan* field_sub_plan(void* field)
+    {
+        return parse_plan_of(static_cast<T*>(field));
+    }
+
+    template <class T>
+    constexpr decltype(FieldOps::sub_plan) get_sub_plan_function(std::true_type)
+    {
+        return &field_sub_plan<T>;
+    }
+
+    template <class T>
+    constexpr decltype(FieldOps::sub_plan) get_sub_plan_function(std::false_type)
+    {
+        return nullptr;
+    }
+
+    template <class T>
+    const FieldOps* get_field_ops()
+    {
+        static const FieldOps ops = {
+            field_opcode<T>::value,
+            sizeof(Handler<T>),
+            &construct_field_handler<T>,
+            get_sub_plan_function<T>(
+                std::integral_constant<bool, field_opcode<T>::value == FieldOps::OP_OBJECT>()),
+            &write_erased<Handler<T>, CompactSinkWriter>,
+            &write_erased<Handler<T>, PrettySinkWriter>};
+        return &ops;
+    }
+}
 }
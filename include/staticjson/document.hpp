@@ -84,6 +84,8 @@ namespace nonpublic
 template <class T>
 bool from_json_value(const Value& v, T* t, ParseStatus* status)
 {
+    nonpublic::RootArenaScope arena_scope;
+    nonpublic::MemoryAccountScope memory_account(status);
     Handler<T> h(t);
     return nonpublic::write_value(v, &h, status);
 }
@@ -99,6 +101,7 @@ bool from_json_document(const Document& d,
 template <class T>
 bool to_json_value(Value* v, MemoryPoolAllocator* alloc, const T& t, ParseStatus* status)
 {
+    nonpublic::RootArenaScope arena_scope;
     Handler<T> h(const_cast<T*>(&t));
     return nonpublic::read_value(v, alloc, &h, status);
 }
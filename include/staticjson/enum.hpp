@@ -33,20 +33,25 @@ public:
                 return true;
             }
         }
-        the_error.reset(new error::InvalidEnumError(std::string(str, str + sz)));
+        the_error.reset(
+            new error::InvalidEnumError(std::string(str, nonpublic::detail_length(sz))));
         return false;
     }
 
     bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
     {
         const auto& mapping = get_mapping();
         for (const std::pair<std::string, Enum>& pair : mapping)
         {
             if (*m_value == pair.second)
-            {
-                output->String(pair.first.data(), static_cast<SizeType>(pair.first.size()), false);
-                return true;
-            }
+                return w.String(pair.first.data(), static_cast<SizeType>(pair.first.size()), false);
         }
         return false;
     }
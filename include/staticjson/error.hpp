@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <iterator>
 #include <string>
 #include <utility>
@@ -14,6 +15,12 @@ std::string quote(const std::string& str);
 class ErrorStack;
 class ErrorBase;
 
+namespace nonpublic
+{
+    // Renders the name of a type on demand, so that it is only built when somebody reads it
+    typedef std::string (*TypeNameRenderer)();
+}
+
 namespace error
 {
     namespace internal
@@ -40,6 +47,10 @@ public:
     virtual bool is_intermediate() const { return false; }
     virtual ~ErrorBase() {}
     virtual std::string description() const = 0;
+
+    // Errors reuse the memory of those freed before on the same thread
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr, std::size_t size) noexcept;
 };
 
 namespace error
@@ -50,7 +61,7 @@ namespace error
                             TYPE_MISMATCH = 4, NUMBER_OUT_OF_RANGE = 5, ARRAY_LENGTH_MISMATCH = 6,
                             UNKNOWN_FIELD = 7, DUPLICATE_KEYS = 8, CORRUPTED_DOM = 9,
                             TOO_DEEP_RECURSION = 10, INVALID_ENUM = 11, TOO_MANY_LEAVES = 12,
-                            CUSTOM = -1;
+                            MEMORY_BUDGET_EXCEEDED = 13, CUSTOM = -1;
 
     class Success : public ErrorBase
     {
@@ -70,12 +81,22 @@ namespace error
     {
     private:
         std::string m_member_name;
+        std::size_t m_index = 0;
 
     public:
         explicit ObjectMemberError(std::string memberName) { m_member_name.swap(memberName); }
 
+        explicit ObjectMemberError(std::string memberName, std::size_t idx) : m_index(idx)
+        {
+            m_member_name.swap(memberName);
+        }
+
         const std::string& member_name() const { return m_member_name; }
 
+        // Position of the member among the registered fields of an object, ordered by name, or
+        // among the members of a JSON object parsed into a map
+        std::size_t index() const { return m_index; }
+
         std::string description() const;
 
         error_type type() const { return OBJECT_MEMBER; }
@@ -116,7 +137,8 @@ namespace error
     class TypeMismatchError : public ErrorBase
     {
     private:
-        std::string m_expected_type;
+        mutable std::string m_expected_type;
+        mutable nonpublic::TypeNameRenderer m_render_expected = nullptr;
         std::string m_actual_type;
 
     public:
@@ -126,7 +148,21 @@ namespace error
             m_actual_type.swap(actualType);
         }
 
-        const std::string& expected_type() const { return m_expected_type; }
+        // The expected type is rendered by `expectedType` when first asked for
+        explicit TypeMismatchError(nonpublic::TypeNameRenderer expectedType, const char* actualType)
+            : m_render_expected(expectedType), m_actual_type(actualType)
+        {
+        }
+
+        const std::string& expected_type() const
+        {
+            if (m_render_expected)
+            {
+                m_expected_type = m_render_expected();
+                m_render_expected = nullptr;
+            }
+            return m_expected_type;
+        }
 
         const std::string& actual_type() const { return m_actual_type; }
 
@@ -145,9 +181,15 @@ namespace error
         std::string description() const override;
         error_type type() const override { return TOO_MANY_LEAVES; }
     };
+    class MemoryBudgetExceededError : public ErrorBase
+    {
+        std::string description() const override;
+        error_type type() const override { return MEMORY_BUDGET_EXCEEDED; }
+    };
     class NumberOutOfRangeError : public ErrorBase
     {
-        std::string m_expected_type;
+        mutable std::string m_expected_type;
+        mutable nonpublic::TypeNameRenderer m_render_expected = nullptr;
         std::string m_actual_type;
 
     public:
@@ -157,7 +199,22 @@ namespace error
             m_actual_type.swap(actualType);
         }
 
-        const std::string& expected_type() const { return m_expected_type; }
+        // The expected type is rendered by `expectedType` when first asked for
+        explicit NumberOutOfRangeError(nonpublic::TypeNameRenderer expectedType,
+                                       const char* actualType)
+            : m_render_expected(expectedType), m_actual_type(actualType)
+        {
+        }
+
+        const std::string& expected_type() const
+        {
+            if (m_render_expected)
+            {
+                m_expected_type = m_render_expected();
+                m_render_expected = nullptr;
+            }
+            return m_expected_type;
+        }
 
         const std::string& actual_type() const { return m_actual_type; }
 
@@ -352,16 +409,92 @@ public:
 // For argument dependent lookup
 inline void swap(ErrorStack& s1, ErrorStack& s2) { s1.swap(s2); }
 
+namespace nonpublic
+{
+    // Active during parses into a code only `ParseStatus`, when errors leave out the names and
+    // messages that would have to be allocated
+    class CodeOnlyErrorScope
+    {
+    private:
+        bool previous;
+
+    public:
+        explicit CodeOnlyErrorScope(bool enable) noexcept;
+        CodeOnlyErrorScope(const CodeOnlyErrorScope&) = delete;
+        CodeOnlyErrorScope& operator=(const CodeOnlyErrorScope&) = delete;
+        ~CodeOnlyErrorScope();
+
+        static bool active() noexcept;
+    };
+
+    // The length of a name or message to copy into an error, which is zero in code only parses
+    inline std::size_t detail_length(std::size_t length) noexcept
+    {
+        return CodeOnlyErrorScope::active() ? 0 : length;
+    }
+}
+
+// Memory taken by a parse, both by its handlers and by the parsed value. The value is counted
+// as it grows: the buffers of strings, and the elements and entries of containers, estimated
+// from their sizes.
+struct MemoryUsage
+{
+    std::size_t bytes = 0;
+    std::size_t allocations = 0;
+    // The most bytes held at once. Memory released during the parse is not counted in it.
+    std::size_t peak = 0;
+};
+
 class ParseStatus
 {
+public:
+    static const std::size_t max_path_length = 16;
+
 private:
     ErrorStack m_stack;
     std::size_t m_offset;
     int m_code;
+    bool m_code_only = false;
+    error::error_type m_error_type = error::SUCCESS;
+    std::uint32_t m_path[max_path_length] = {};
+    std::size_t m_path_length = 0;
+    MemoryUsage m_memory_usage;
+    std::size_t m_memory_budget = 0;
 
 public:
     explicit ParseStatus() : m_stack(), m_offset(), m_code() {}
 
+    // Without the error stack, the error is only kept as `error_type` and `path`, so that a
+    // failed parse allocates nothing for it
+    explicit ParseStatus(bool code_only) : m_stack(), m_offset(), m_code(), m_code_only(code_only)
+    {
+    }
+
+    bool is_code_only() const { return m_code_only; }
+
+    // Moves the error stack of a code only status into `error_type` and `path`
+    void compact_errors();
+
+    // Type of the innermost error that is not just a location, in code only statuses
+    error::error_type error_type() const { return m_error_type; }
+
+    // Indices of the members and elements leading to the error, outermost first. Deeper paths
+    // are cut short at `max_path_length`.
+    std::size_t path_length() const { return m_path_length; }
+
+    std::size_t path(std::size_t i) const { return m_path[i]; }
+
+    // Fails parses taking more than `bytes` with `error::MEMORY_BUDGET_EXCEEDED`. Zero means no
+    // limit.
+    void set_memory_budget(std::size_t bytes) { m_memory_budget = bytes; }
+
+    std::size_t memory_budget() const { return m_memory_budget; }
+
+    // Of the last parse with this status
+    const MemoryUsage& memory_usage() const { return m_memory_usage; }
+
+    MemoryUsage& memory_usage() { return m_memory_usage; }
+
     void set_result(int err, std::size_t off)
     {
         m_code = err;
@@ -393,6 +526,12 @@ public:
         std::swap(m_code, other.m_code);
         std::swap(m_offset, other.m_offset);
         m_stack.swap(other.m_stack);
+        std::swap(m_code_only, other.m_code_only);
+        std::swap(m_error_type, other.m_error_type);
+        std::swap(m_path, other.m_path);
+        std::swap(m_path_length, other.m_path_length);
+        std::swap(m_memory_usage, other.m_memory_usage);
+        std::swap(m_memory_budget, other.m_memory_budget);
     }
 
     bool operator!() const { return has_error(); }
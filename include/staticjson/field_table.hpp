@@ -0,0 +1,233 @@
+#pragma once
+#include <staticjson/parse_plan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace staticjson
+{
+// One entry of a field table, naming member `member` of class `C`
+template <class C, class M>
+struct FieldEntry
+{
+    typedef C class_type;
+    typedef M member_type;
+
+    const char* name;
+    SizeType name_length;
+    M C::*member;
+    unsigned flags;
+
+    constexpr FieldEntry(const char* name, SizeType name_length, M C::*member, unsigned flags)
+        : name(name), name_length(name_length), member(member), flags(flags)
+    {
+    }
+};
+
+template <class C, class M, std::size_t N>
+constexpr FieldEntry<C, M>
+field(const char (&name)[N], M C::*member, unsigned flags = Flags::Default)
+{
+    return FieldEntry<C, M>(name, static_cast<SizeType>(N - 1), member, flags);
+}
+
+template <class... Entries>
+struct FieldTable;
+
+template <>
+struct FieldTable<>
+{
+    static const std::size_t size = 0;
+
+    constexpr FieldTable() {}
+};
+
+template <class Head, class... Tail>
+struct FieldTable<Head, Tail...>
+{
+    static const std::size_t size = 1 + sizeof...(Tail);
+
+    Head head;
+    FieldTable<Tail...> tail;
+
+    constexpr FieldTable(Head head, Tail... tail) : head(head), tail(tail...) {}
+};
+
+template <class... Entries>
+constexpr FieldTable<Entries...> make_field_table(Entries... entries)
+{
+    return FieldTable<Entries...>(entries...);
+}
+
+// Specialized by `STATICJSON_FIELDS` with the table of a type
+template <class T>
+struct FieldsOf;
+
+namespace nonpublic
+{
+    constexpr bool same_name(const char* a, const char* b)
+    {
+        return *a == *b && (*a == '\0' || same_name(a + 1, b + 1));
+    }
+
+    constexpr bool table_has_name(const FieldTable<>&, const char*) { return false; }
+
+    template <class Head, class... Tail>
+    constexpr bool table_has_name(const FieldTable<Head, Tail...>& table, const char* name)
+    {
+        return same_name(table.head.name, name) || table_has_name(table.tail, name);
+    }
+
+    constexpr bool has_duplicate_names(const FieldTable<>&) { return false; }
+
+    template <class Head, class... Tail>
+    constexpr bool has_duplicate_names(const FieldTable<Head, Tail...>& table)
+    {
+        return table_has_name(table.tail, table.head.name) || has_duplicate_names(table.tail);
+    }
+
+    // A name of a field table with its index, keyed by length and then first character
+    struct TableKey
+    {
+        std::uint64_t key;
+        const char* name;
+        SizeType name_length;
+        std::size_t index;
+    };
+
+    inline std::uint64_t table_key(const char* name, SizeType length)
+    {
+        return (static_cast<std::uint64_t>(length) << 8)
+            | (length ? static_cast<unsigned char>(name[0]) : 0u);
+    }
+
+    // Orders `keys` by key, then by name
+    void sort_table_keys(TableKey* keys, std::size_t count);
+
+    // Binary searches `keys`, sorted by `sort_table_keys`, on the key of `name`; only names of
+    // the same length and first character are compared in full. Returns the table index, or
+    // `ParsePlan::no_field`.
+    std::size_t
+    find_table_key(const TableKey* keys, std::size_t count, const char* name, SizeType length);
+
+    inline void collect_table_keys(TableKey*, const FieldTable<>&, std::size_t) {}
+
+    template <class Head, class... Tail>
+    void collect_table_keys(TableKey* out,
+                            const FieldTable<Head, Tail...>& table,
+                            std::size_t index)
+    {
+        out->key = table_key(table.head.name, table.head.name_length);
+        out->name = table.head.name;
+        out->name_length = table.head.name_length;
+        out->index = index;
+        collect_table_keys(out + 1, table.tail, index + 1);
+    }
+
+    template <class T>
+    struct TableIndex
+    {
+        static const std::size_t size = decltype(FieldsOf<T>::table())::size;
+
+        TableKey keys[size + 1];
+
+        TableIndex()
+        {
+            collect_table_keys(keys, FieldsOf<T>::table(), 0);
+            sort_table_keys(keys, size);
+        }
+    };
+
+    // The key lookup of the plan of `T`, over the names of its table sorted once
+    template <class T>
+    std::size_t find_table_field(const char* name, SizeType length)
+    {
+        static const TableIndex<T> index;
+        return find_table_key(index.keys, TableIndex<T>::size, name, length);
+    }
+
+    template <class T>
+    void resolve_fields(T*, TableField*, const FieldTable<>&)
+    {
+    }
+
+    template <class T, class Head, class... Tail>
+    void resolve_fields(T* t, TableField* out, const FieldTable<Head, Tail...>& table)
+    {
+        auto* member = &(t->*table.head.member);
+        out->name = table.head.name;
+        out->name_length = table.head.name_length;
+        out->flags = table.head.flags;
+        out->offset = static_cast<std::size_t>(reinterpret_cast<char*>(member)
+                                               - reinterpret_cast<char*>(t));
+        out->field = member;
+        out->ops = get_field_ops<typename Head::member_type>();
+        resolve_fields(t, out + 1, table.tail);
+    }
+
+    template <class T>
+    ParsePlan* compile_fields_plan(T* sample)
+    {
+        typedef decltype(FieldsOf<T>::table()) table_type;
+        TableField entries[table_type::size + 1];
+        resolve_fields(sample, entries, FieldsOf<T>::table());
+        return compile_table_plan(
+            entries, table_type::size, FieldsOf<T>::flags(), &find_table_field<T>);
+    }
+
+    template <class T>
+    void add_fields(T*, ObjectHandler*, const FieldTable<>&)
+    {
+    }
+
+    template <class T, class Head, class... Tail>
+    void add_fields(T* t, ObjectHandler* h, const FieldTable<Head, Tail...>& table)
+    {
+        h->add_property(table.head.name, &(t->*table.head.member), table.head.flags);
+        add_fields(t, h, table.tail);
+    }
+}
+}
+
+// Declares the fields of `type` as a constant table, where each entry is written as
+// `field(name, &type::member)` or `field(name, &type::member, flags)`. Such a type is registered
+// without `staticjson_init`, and is parsed and serialized through a parse plan (see
+// `STATICJSON_DECLARE_PARSE_PLAN`) compiled straight from the table, whose keys are looked up by
+// length and first character among the names in the table. No `ObjectHandler` is built unless
+// parsing limits are configured. The table is available at compile time as
+// `staticjson::FieldsOf<type>::table()`.
+//
+// Note that this macro must not be instantiated inside a namespace.
+#define STATICJSON_FIELDS(type, ...)                                                               \
+    STATICJSON_FIELDS_WITH_FLAGS(type, ::staticjson::Flags::Default, __VA_ARGS__)
+
+// Like `STATICJSON_FIELDS`, with `object_flags` set as by `ObjectHandler::set_flags`.
+#define STATICJSON_FIELDS_WITH_FLAGS(type, object_flags, ...)                                      \
+    namespace staticjson                                                                           \
+    {                                                                                              \
+        template <>                                                                                \
+        struct FieldsOf<type>                                                                      \
+        {                                                                                          \
+            static constexpr unsigned flags() { return object_flags; }                             \
+            static constexpr decltype(make_field_table(__VA_ARGS__)) table()                       \
+            {                                                                                      \
+                return make_field_table(__VA_ARGS__);                                              \
+            }                                                                                      \
+        };                                                                                         \
+        static_assert(!nonpublic::has_duplicate_names(FieldsOf<type>::table()),                    \
+                      "Duplicate field names for " #type);                                         \
+        inline void init(type* t, ObjectHandler* h)                                                \
+        {                                                                                          \
+            nonpublic::add_fields(t, h, FieldsOf<type>::table());                                  \
+            h->set_flags(FieldsOf<type>::flags());                                                 \
+        }                                                                                          \
+        namespace nonpublic                                                                        \
+        {                                                                                          \
+            template <>                                                                            \
+            inline ParsePlan* compile_object_plan<type>(type* sample)                              \
+            {                                                                                      \
+                return compile_fields_plan(sample);                                                \
+            }                                                                                      \
+        }                                                                                          \
+    }                                                                                              \
+    STATICJSON_DECLARE_PARSE_PLAN(type)
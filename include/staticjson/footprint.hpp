@@ -0,0 +1,62 @@
+#pragma once
+#include <staticjson/basic.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <string>
+#include <type_traits>
+
+namespace staticjson
+{
+struct HandlerFootprint
+{
+    FootprintNode root;
+    // Average time to construct the handler tree, without the field handlers that are created
+    // when their key is first seen
+    std::chrono::nanoseconds construction_time{0};
+
+    std::string description() const;
+};
+
+// Reports the memory taken by the handlers that parse `*value`, part by part, and the time it
+// takes to construct them. Field handlers otherwise created during parsing are created for the
+// report, except where a type contains itself.
+template <class T>
+HandlerFootprint handler_footprint(T* value, std::size_t samples = 16)
+{
+    typedef Handler<T> handler_type;
+    typedef std::chrono::steady_clock clock;
+
+    nonpublic::RootArenaScope arena_scope;
+    typename std::aligned_storage<sizeof(handler_type), alignof(handler_type)>::type storage;
+    clock::duration elapsed = clock::duration::zero();
+    for (std::size_t i = 0; i < samples; ++i)
+    {
+        clock::time_point start = clock::now();
+        handler_type* h = new (&storage) handler_type(value);
+        elapsed += clock::now() - start;
+        h->~handler_type();
+    }
+
+    HandlerFootprint result;
+    if (samples)
+    {
+        result.construction_time
+            = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed) / samples;
+    }
+    handler_type h(value);
+    result.root.name = "root";
+    result.root.bytes = sizeof(handler_type);
+    result.root.objects = 1;
+    nonpublic::describe_handler(result.root, h);
+    return result;
+}
+
+template <class T>
+HandlerFootprint handler_footprint(std::size_t samples = 16)
+{
+    T value;
+    return handler_footprint(&value, samples);
+}
+}
@@ -0,0 +1,271 @@
+#pragma once
+#include <staticjson/stl_types.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace staticjson
+{
+namespace nonpublic
+{
+    struct InternEntry
+    {
+        std::string str;
+        std::size_t hash;
+    };
+
+    std::size_t hash_string(const char* str, std::size_t length) noexcept;
+}
+
+// An immutable string whose characters are shared by all equal strings drawn from the same
+// `InternTable`. Copying one only copies a reference.
+class InternedString
+{
+private:
+    std::shared_ptr<const nonpublic::InternEntry> entry;
+
+    friend class InternTable;
+
+public:
+    InternedString() noexcept {}
+    InternedString(const char* str, std::size_t length);
+    explicit InternedString(const std::string& str) : InternedString(str.data(), str.size()) {}
+
+    // Replaces the value with `str`, interned in `InternTable::current()`
+    void assign(const char* str, std::size_t length);
+    void clear() noexcept { entry.reset(); }
+
+    const char* data() const noexcept { return entry ? entry->str.data() : ""; }
+    std::size_t size() const noexcept { return entry ? entry->str.size() : 0; }
+    bool empty() const noexcept { return size() == 0; }
+    std::size_t hash() const noexcept
+    {
+        return entry ? entry->hash : nonpublic::hash_string("", 0);
+    }
+    std::string str() const { return std::string(data(), size()); }
+
+    bool operator==(const InternedString& other) const noexcept
+    {
+        return entry == other.entry
+            || (hash() == other.hash() && size() == other.size()
+                && std::char_traits<char>::compare(data(), other.data(), size()) == 0);
+    }
+    bool operator!=(const InternedString& other) const noexcept { return !(*this == other); }
+    bool operator<(const InternedString& other) const noexcept
+    {
+        int c = std::char_traits<char>::compare(
+            data(), other.data(), std::min(size(), other.size()));
+        return c < 0 || (c == 0 && size() < other.size());
+    }
+};
+
+// Decides which strings leave a full shard of an `InternTable`. Each shard has its own policy,
+// which is only called with the shard locked. Strings are identified by their address, which
+// stays the same while they are in the table.
+class InternEvictionPolicy
+{
+public:
+    virtual ~InternEvictionPolicy() {}
+
+    virtual void inserted(const std::string* str) = 0;
+    virtual void used(const std::string* str) = 0;
+    virtual void erased(const std::string* str) = 0;
+
+    // The string to evict to make room for another, or null to leave the new one out of the
+    // table instead
+    virtual const std::string* victim() = 0;
+};
+
+// Evicts the string that was looked up least recently
+class LruEvictionPolicy : public InternEvictionPolicy
+{
+private:
+    std::list<const std::string*> order;
+    std::unordered_map<const std::string*, std::list<const std::string*>::iterator> positions;
+
+public:
+    void inserted(const std::string* str) override;
+    void used(const std::string* str) override;
+    void erased(const std::string* str) override;
+    const std::string* victim() override;
+};
+
+struct InternTableOptions
+{
+    // Upper bound of the number of strings kept, split evenly among the shards
+    std::size_t max_entries = 64 * 1024;
+    // Number of independently locked parts, rounded up to a power of two
+    std::size_t shards = 16;
+    // Strings longer than this are never interned
+    std::size_t max_length = 256;
+    // Makes the eviction policy of each shard. When empty, a full table interns no more strings.
+    std::function<std::unique_ptr<InternEvictionPolicy>()> make_policy;
+};
+
+struct InternStats
+{
+    std::size_t entries = 0;
+    // Bytes of characters held by the table
+    std::size_t bytes = 0;
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+    // Strings not interned because they were too long or the table was full
+    std::size_t rejected = 0;
+};
+
+// A thread safe set of strings from which `InternedString` values are drawn. Evicting a string
+// only removes it from the table; values already holding it keep it alive.
+class InternTable
+{
+private:
+    struct Key
+    {
+        const char* data;
+        std::size_t size;
+        std::size_t hash;
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key& k) const noexcept { return k.hash; }
+    };
+
+    struct KeyEqual
+    {
+        bool operator()(const Key& a, const Key& b) const noexcept
+        {
+            return a.size == b.size && std::char_traits<char>::compare(a.data, b.data, a.size) == 0;
+        }
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<Key, std::shared_ptr<const nonpublic::InternEntry>, KeyHash, KeyEqual>
+            entries;
+        std::unique_ptr<InternEvictionPolicy> policy;
+        InternStats stats;
+    };
+
+    InternTableOptions options;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::size_t max_entries_per_shard;
+
+public:
+    explicit InternTable(const InternTableOptions& options = InternTableOptions());
+    InternTable(const InternTable&) = delete;
+    InternTable& operator=(const InternTable&) = delete;
+    ~InternTable();
+
+    InternedString intern(const char* str, std::size_t length);
+    InternedString intern(const std::string& str) { return intern(str.data(), str.size()); }
+
+    InternStats stats() const;
+    void clear();
+
+    // The table used by `InternedString` on this thread (see `InternTableScope`)
+    static InternTable* current() noexcept;
+    static InternTable& global();
+};
+
+// Makes `table` the source of interned strings parsed or constructed on this thread during its
+// lifetime.
+class InternTableScope
+{
+private:
+    InternTable* previous;
+
+public:
+    explicit InternTableScope(InternTable* table) noexcept;
+    InternTableScope(const InternTableScope&) = delete;
+    InternTableScope& operator=(const InternTableScope&) = delete;
+    ~InternTableScope();
+};
+
+template <>
+class Handler<InternedString> : public BaseHandler
+{
+private:
+    InternedString* m_value;
+
+public:
+    explicit Handler(InternedString* v) : m_value(v) {}
+
+    bool String(const char* str, SizeType length, bool) override
+    {
+        m_value->assign(str, length);
+        this->parsed = true;
+        return true;
+    }
+
+    std::string type_name() const override { return "string"; }
+
+    bool write(IHandler* out) const override
+    {
+        nonpublic::IHandlerWriter w(out);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
+    {
+        return w.String(m_value->data(), SizeType(m_value->size()), true);
+    }
+
+    void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
+    {
+        output.SetObject();
+        output.AddMember(rapidjson::StringRef("type"), rapidjson::StringRef("string"), alloc);
+    }
+};
+
+template <class T, class Hash, class Equal, class Alloc>
+class Handler<std::unordered_map<InternedString, T, Hash, Equal, Alloc>>
+    : public MapHandler<std::unordered_map<InternedString, T, Hash, Equal, Alloc>>
+{
+public:
+    explicit Handler(std::unordered_map<InternedString, T, Hash, Equal, Alloc>* value)
+        : Handler::MapHandler(value)
+    {
+    }
+
+    std::string type_name() const override
+    {
+        return "std::unordered_map<InternedString, " + this->internal_handler.type_name() + ">";
+    }
+};
+
+template <class T, class Compare, class Alloc>
+class Handler<std::map<InternedString, T, Compare, Alloc>>
+    : public MapHandler<std::map<InternedString, T, Compare, Alloc>>
+{
+public:
+    explicit Handler(std::map<InternedString, T, Compare, Alloc>* value)
+        : Handler::MapHandler(value)
+    {
+    }
+
+    std::string type_name() const override
+    {
+        return "std::map<InternedString, " + this->internal_handler.type_name() + ">";
+    }
+};
+}
+
+namespace std
+{
+template <>
+struct hash<staticjson::InternedString>
+{
+    std::size_t operator()(const staticjson::InternedString& s) const noexcept { return s.hash(); }
+};
+}
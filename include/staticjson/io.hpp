@@ -2,20 +2,120 @@
 
 #include <staticjson/basic.hpp>
 
+#include <rapidjson/filereadstream.h>
+#include <rapidjson/reader.h>
+
+#include <cstddef>
 #include <cstdio>
 #include <string>
+#include <vector>
 
 namespace staticjson
 {
+struct FdOutputOptions
+{
+    // Size of the output buffer, which is also the growth step of the memory mapped mode.
+    std::size_t buffer_size = 1 << 20;
+    bool pretty = false;
+    // Write through a shared memory mapping of the file instead of write(2). The descriptor must
+    // refer to a regular file opened for both reading and writing.
+    bool memory_mapped = false;
+};
 
 namespace nonpublic
 {
+    // Moves the errors of `handler` into `status`, compacted if `status` asks for it
+    void reap_errors(BaseHandler* handler, ParseStatus* status);
     bool parse_json_string(const char* str, BaseHandler* handler, ParseStatus* status);
     bool parse_json_file(std::FILE* fp, BaseHandler* handler, ParseStatus* status);
     std::string serialize_json_string(const BaseHandler* handler);
     bool serialize_json_file(std::FILE* fp, const BaseHandler* handler);
     std::string serialize_pretty_json_string(const BaseHandler* handler);
     bool serialize_pretty_json_file(std::FILE* fp, const BaseHandler* handler);
+    bool serialize_json_sink(IOutputSink* sink, const BaseHandler* handler);
+    bool serialize_pretty_json_sink(IOutputSink* sink, const BaseHandler* handler);
+    std::size_t serialized_json_size(const BaseHandler* handler);
+#ifndef _WIN32
+    bool serialize_json_fd(int fd, const BaseHandler* handler, const FdOutputOptions& options);
+#endif
+    std::size_t
+    serialize_json_buffer(char* buffer, std::size_t capacity, const BaseHandler* handler);
+    std::size_t
+    serialize_pretty_json_buffer(char* buffer, std::size_t capacity, const BaseHandler* handler);
+    std::size_t serialized_pretty_json_size(const BaseHandler* handler);
+
+    // Forwards reader events to `H` by qualified, and thus non-virtual, calls. Handlers holding
+    // their children by exact type do the same, so the parse of a whole type tree can be inlined
+    // into the reader loop instead of dispatching through `IHandler` at every level. `H` must be
+    // the dynamic type of the handler.
+    template <class H>
+    class StaticReaderHandler
+    {
+    private:
+        H* h;
+        const MemoryAccountScope* account;
+
+        // Chunks for handlers are taken without a chance to fail, so the parse is stopped after
+        // the event that went over the budget instead
+        bool within_budget() const { return !account || !account->over_budget(); }
+
+    public:
+        explicit StaticReaderHandler(H* h) : h(h), account(active_memory_account()) {}
+
+        bool Null() { return h->H::Null() && within_budget(); }
+        bool Bool(bool b) { return h->H::Bool(b) && within_budget(); }
+        bool Int(int i) { return h->H::Int(i) && within_budget(); }
+        bool Uint(unsigned i) { return h->H::Uint(i) && within_budget(); }
+        bool Int64(std::int64_t i) { return h->H::Int64(i) && within_budget(); }
+        bool Uint64(std::uint64_t i) { return h->H::Uint64(i) && within_budget(); }
+        bool Double(double d) { return h->H::Double(d) && within_budget(); }
+        bool RawNumber(const char* str, SizeType length, bool copy)
+        {
+            return h->H::RawNumber(str, length, copy) && within_budget();
+        }
+        bool String(const char* str, SizeType length, bool copy)
+        {
+            return h->H::String(str, length, copy) && within_budget();
+        }
+        bool StartObject() { return h->H::StartObject() && within_budget(); }
+        bool Key(const char* str, SizeType length, bool copy)
+        {
+            return h->H::Key(str, length, copy) && within_budget();
+        }
+        bool EndObject(SizeType length) { return h->H::EndObject(length) && within_budget(); }
+        bool StartArray() { return h->H::StartArray() && within_budget(); }
+        bool EndArray(SizeType length) { return h->H::EndArray(length) && within_budget(); }
+    };
+
+    template <unsigned ParseFlags = rapidjson::kParseDefaultFlags, class H, class InputStream>
+    inline bool parse_static(InputStream& is, H* handler, ParseStatus* status)
+    {
+        CodeOnlyErrorScope code_only(status && status->is_code_only());
+        StaticReaderHandler<H> forwarder(handler);
+        rapidjson::Reader r;
+        rapidjson::ParseResult rc = r.Parse<ParseFlags>(is, forwarder);
+        if (status)
+        {
+            status->set_result(rc.Code(), rc.Offset());
+            reap_errors(handler, status);
+        }
+        return rc.Code() == 0;
+    }
+
+    template <class Writer, class T>
+    inline bool serialize_static(IOutputSink* sink, const T& value, bool trailing_newline)
+    {
+        RootArenaScope arena_scope;
+        Handler<T> h(const_cast<T*>(&value));
+        char buffer[4096];
+        SinkOutputStream os(sink, buffer, sizeof(buffer));
+        Writer writer(os);
+        bool res = write_static(h, writer);
+        if (trailing_newline)
+            os.Put('\n');
+        os.Flush();
+        return res && os.good();
+    }
 
     struct FileGuard : private NonMobile
     {
@@ -33,15 +133,36 @@ namespace nonpublic
 template <class T>
 inline bool from_json_string(const char* str, T* value, ParseStatus* status)
 {
+    nonpublic::RootArenaScope arena_scope;
+    nonpublic::MemoryAccountScope memory_account(status);
     Handler<T> h(value);
-    return nonpublic::parse_json_string(str, &h, status);
+    rapidjson::StringStream is(str);
+    return nonpublic::parse_static(is, &h, status);
+}
+
+// Parses `str` in place, overwriting it with the decoded strings. `StringSlice` and
+// `std::string_view` fields of `value` then point into `str`, which must outlive them.
+template <class T>
+inline bool from_json_insitu(char* str, T* value, ParseStatus* status)
+{
+    nonpublic::RootArenaScope arena_scope;
+    nonpublic::MemoryAccountScope memory_account(status);
+    Handler<T> h(value);
+    rapidjson::InsituStringStream is(str);
+    return nonpublic::parse_static<rapidjson::kParseInsituFlag>(is, &h, status);
 }
 
 template <class T>
 inline bool from_json_file(std::FILE* fp, T* value, ParseStatus* status)
 {
+    if (!fp)
+        return false;
+    nonpublic::RootArenaScope arena_scope;
+    nonpublic::MemoryAccountScope memory_account(status);
     Handler<T> h(value);
-    return nonpublic::parse_json_file(fp, &h, status);
+    char buffer[1000];
+    rapidjson::FileReadStream is(fp, buffer, sizeof(buffer));
+    return nonpublic::parse_static(is, &h, status);
 }
 
 template <class T>
@@ -60,13 +181,16 @@ inline bool from_json_file(const std::string& filename, T* value, ParseStatus* s
 template <class T>
 inline std::string to_json_string(const T& value)
 {
-    Handler<T> h(const_cast<T*>(&value));
-    return nonpublic::serialize_json_string(&h);
+    std::string result;
+    StringSink sink(&result);
+    nonpublic::serialize_static<nonpublic::CompactSinkWriter>(&sink, value, false);
+    return result;
 }
 
 template <class T>
 inline bool to_json_file(std::FILE* fp, const T& value)
 {
+    nonpublic::RootArenaScope arena_scope;
     Handler<T> h(const_cast<T*>(&value));
     return nonpublic::serialize_json_file(fp, &h);
 }
@@ -85,15 +209,36 @@ inline bool to_json_file(const std::string& filename, const T& value)
 }
 
 template <class T>
-inline std::string to_pretty_json_string(const T& value)
+inline bool to_json_sink(IOutputSink* sink, const T& value)
 {
+    return nonpublic::serialize_static<nonpublic::CompactSinkWriter>(sink, value, false);
+}
+
+#ifndef _WIN32
+// Writes to a POSIX file descriptor at its current offset, bypassing stdio.
+template <class T>
+inline bool
+to_json_fd(int fd, const T& value, const FdOutputOptions& options = FdOutputOptions())
+{
+    nonpublic::RootArenaScope arena_scope;
     Handler<T> h(const_cast<T*>(&value));
-    return nonpublic::serialize_pretty_json_string(&h);
+    return nonpublic::serialize_json_fd(fd, &h, options);
+}
+#endif
+
+template <class T>
+inline std::string to_pretty_json_string(const T& value)
+{
+    std::string result;
+    StringSink sink(&result);
+    nonpublic::serialize_static<nonpublic::PrettySinkWriter>(&sink, value, true);
+    return result;
 }
 
 template <class T>
 inline bool to_pretty_json_file(std::FILE* fp, const T& value)
 {
+    nonpublic::RootArenaScope arena_scope;
     Handler<T> h(const_cast<T*>(&value));
     return nonpublic::serialize_pretty_json_file(fp, &h);
 }
@@ -111,9 +256,80 @@ inline bool to_pretty_json_file(const std::string& filename, const T& value)
     return to_pretty_json_file(filename.c_str(), value);
 }
 
+template <class T>
+inline bool to_pretty_json_sink(IOutputSink* sink, const T& value)
+{
+    return nonpublic::serialize_static<nonpublic::PrettySinkWriter>(sink, value, true);
+}
+
+// Writes to a rapidjson style writer, e.g. a `rapidjson::Writer` or `rapidjson::PrettyWriter`
+// over a custom stream. Primitives and standard containers call the writer directly. Fields of
+// reflected structs are written through a virtual adapter unless the writer is one of the
+// library's own, so the writer also needs `RawValue`.
+template <class Writer, class T>
+inline bool write_json(Writer& writer, const T& value)
+{
+    nonpublic::RootArenaScope arena_scope;
+    Handler<T> h(const_cast<T*>(&value));
+    return nonpublic::write_static(h, writer);
+}
+
+// Serializes into a caller-owned buffer without allocating. Like `snprintf`, returns the size of
+// the complete output, and only the first `capacity` bytes are written when it is larger. No null
+// terminator is appended. Returns 0 if the value cannot be serialized.
+template <class T>
+inline std::size_t to_json_buffer(char* buffer, std::size_t capacity, const T& value)
+{
+    nonpublic::RootArenaScope arena_scope;
+    Handler<T> h(const_cast<T*>(&value));
+    return nonpublic::serialize_json_buffer(buffer, capacity, &h);
+}
+
+template <class T>
+inline std::size_t to_pretty_json_buffer(char* buffer, std::size_t capacity, const T& value)
+{
+    nonpublic::RootArenaScope arena_scope;
+    Handler<T> h(const_cast<T*>(&value));
+    return nonpublic::serialize_pretty_json_buffer(buffer, capacity, &h);
+}
+
+// Appends to `output`, reusing its existing capacity.
+template <class T>
+inline bool append_json(std::string& output, const T& value)
+{
+    StringSink sink(&output);
+    return to_json_sink(&sink, value);
+}
+
+template <class T>
+inline bool append_pretty_json(std::string& output, const T& value)
+{
+    StringSink sink(&output);
+    return to_pretty_json_sink(&sink, value);
+}
+
+// The exact number of bytes `to_json_string` would produce, computed without materializing them.
+template <class T>
+inline std::size_t serialized_size(const T& value)
+{
+    nonpublic::RootArenaScope arena_scope;
+    Handler<T> h(const_cast<T*>(&value));
+    return nonpublic::serialized_json_size(&h);
+}
+
+// The exact number of bytes `to_pretty_json_string` would produce.
+template <class T>
+inline std::size_t serialized_pretty_size(const T& value)
+{
+    nonpublic::RootArenaScope arena_scope;
+    Handler<T> h(const_cast<T*>(&value));
+    return nonpublic::serialized_pretty_json_size(&h);
+}
+
 template <class T>
 inline Document export_json_schema(T* value, Document::AllocatorType* allocator = nullptr)
 {
+    nonpublic::RootArenaScope arena_scope;
     Handler<T> h(value);
     Document d;
     h.generate_schema(d, allocator ? *allocator : d.GetAllocator());
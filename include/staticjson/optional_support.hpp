@@ -40,14 +40,20 @@ class Handler<optional<T>> : public BaseHandler
 {
 public:
     using ElementType = T;
+    typedef Handler<ElementType> internal_type;
 
 protected:
     mutable optional<T>* m_value;
     mutable optional<Handler<ElementType>> internal_handler;
+    // Taken when this handler is built, so that the inner handler comes from the same arena
+    mempool::ChunkAllocator* chunks;
     int depth = 0;
 
 public:
-    explicit Handler(optional<T>* value) : m_value(value) {}
+    explicit Handler(optional<T>* value)
+        : m_value(value), chunks(mempool::current_chunk_allocator())
+    {
+    }
 
 protected:
     void initialize()
@@ -55,10 +61,16 @@ protected:
         if (!internal_handler)
         {
             m_value->emplace();
-            internal_handler.emplace(&(**m_value));
+            emplace_handler();
         }
     }
 
+    void emplace_handler() const
+    {
+        mempool::ChunkAllocatorScope chunk_scope(chunks);
+        internal_handler.emplace(&(**m_value));
+    }
+
     void reset() override
     {
         depth = 0;
@@ -85,21 +97,28 @@ public:
         else
         {
             initialize();
-            return postcheck(internal_handler->Null());
+            return postcheck(internal_handler->internal_type::Null());
         }
     }
 
     bool write(IHandler* out) const override
+    {
+        nonpublic::IHandlerWriter w(out);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
     {
         if (!m_value || !(*m_value))
         {
-            return out->Null();
+            return w.Null();
         }
         if (!internal_handler)
         {
-            internal_handler.emplace(&(**m_value));
+            emplace_handler();
         }
-        return internal_handler->write(out);
+        return nonpublic::write_static(*internal_handler, w);
     }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
@@ -119,81 +138,88 @@ public:
     bool Bool(bool b) override
     {
         initialize();
-        return postcheck(internal_handler->Bool(b));
+        return postcheck(internal_handler->internal_type::Bool(b));
     }
 
     bool Int(int i) override
     {
         initialize();
-        return postcheck(internal_handler->Int(i));
+        return postcheck(internal_handler->internal_type::Int(i));
     }
 
     bool Uint(unsigned i) override
     {
         initialize();
-        return postcheck(internal_handler->Uint(i));
+        return postcheck(internal_handler->internal_type::Uint(i));
     }
 
     bool Int64(std::int64_t i) override
     {
         initialize();
-        return postcheck(internal_handler->Int64(i));
+        return postcheck(internal_handler->internal_type::Int64(i));
     }
 
     bool Uint64(std::uint64_t i) override
     {
         initialize();
-        return postcheck(internal_handler->Uint64(i));
+        return postcheck(internal_handler->internal_type::Uint64(i));
     }
 
     bool Double(double i) override
     {
         initialize();
-        return postcheck(internal_handler->Double(i));
+        return postcheck(internal_handler->internal_type::Double(i));
     }
 
     bool String(const char* str, SizeType len, bool copy) override
     {
         initialize();
-        return postcheck(internal_handler->String(str, len, copy));
+        return postcheck(internal_handler->internal_type::String(str, len, copy));
     }
 
     bool Key(const char* str, SizeType len, bool copy) override
     {
         initialize();
-        return postcheck(internal_handler->Key(str, len, copy));
+        return postcheck(internal_handler->internal_type::Key(str, len, copy));
     }
 
     bool StartObject() override
     {
         initialize();
         ++depth;
-        return internal_handler->StartObject();
+        return internal_handler->internal_type::StartObject();
     }
 
     bool EndObject(SizeType len) override
     {
         initialize();
         --depth;
-        return postcheck(internal_handler->EndObject(len));
+        return postcheck(internal_handler->internal_type::EndObject(len));
     }
 
     bool StartArray() override
     {
         initialize();
         ++depth;
-        return postcheck(internal_handler->StartArray());
+        return postcheck(internal_handler->internal_type::StartArray());
     }
 
     bool EndArray(SizeType len) override
     {
         initialize();
         --depth;
-        return postcheck(internal_handler->EndArray(len));
+        return postcheck(internal_handler->internal_type::EndArray(len));
     }
 
     bool has_error() const override { return internal_handler && internal_handler->has_error(); }
 
+    void describe_footprint(FootprintNode& node) const override
+    {
+        if (internal_handler)
+            nonpublic::describe_handler(
+                node.split("value handler", sizeof(Handler<ElementType>)), *internal_handler);
+    }
+
     bool reap_error(ErrorStack& stk) override
     {
         return internal_handler && internal_handler->reap_error(stk);
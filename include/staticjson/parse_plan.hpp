@@ -0,0 +1,266 @@
+#pragma once
+#include <staticjson/basic.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace staticjson
+{
+namespace nonpublic
+{
+    struct PlanField
+    {
+        const char* name;
+        SizeType name_length;
+        const char* quoted_name;
+        SizeType quoted_name_length;
+        std::size_t offset;
+        unsigned flags;
+        const FieldOps* ops;
+        // Set for a nested struct that the plan descends into instead of using a handler
+        const ParsePlan* sub_plan;
+        std::size_t capacity_hint;
+    };
+
+    // The fields of a struct flattened into an array sorted like `ObjectHandler::internals`, with
+    // member offsets in place of handlers.
+    class ParsePlan : private NonMobile
+    {
+    public:
+        std::vector<PlanField> fields;
+        std::unique_ptr<char[]> names;
+        unsigned flags = Flags::Default;
+        // The largest handler needed for a field of this plan or of its nested plans
+        std::size_t max_handler_size = 0;
+        // Set on plans compiled from a field table. Returns the table index of a key, or
+        // `no_field`, from the names of the table indexed by length and first character;
+        // `table_order` maps the index to one in `fields`.
+        std::size_t (*find_in_table)(const char* name, SizeType length) = nullptr;
+        std::vector<std::size_t> table_order;
+
+        static const std::size_t no_field = static_cast<std::size_t>(-1);
+
+        const PlanField* find(const char* name, SizeType length) const;
+
+        std::size_t index_of(const PlanField* field) const
+        {
+            return static_cast<std::size_t>(field - fields.data());
+        }
+    };
+
+    // One entry of a field table, resolved against an instance
+    struct TableField
+    {
+        const char* name;
+        SizeType name_length;
+        unsigned flags;
+        std::size_t offset;
+        void* field;
+        const FieldOps* ops;
+    };
+
+    // Compiles a plan straight from the entries of a field table, in table order, without
+    // registering them on an `ObjectHandler`. Returns null if some field cannot be planned.
+    ParsePlan* compile_table_plan(const TableField* entries,
+                                  std::size_t count,
+                                  unsigned flags,
+                                  std::size_t (*find_in_table)(const char*, SizeType));
+
+}
+
+// Parses a struct by interpreting its compiled `ParsePlan` instead of building a tree of handlers.
+// Nested structs held by value are descended into by the same loop, and fields of common
+// primitive types are stored directly; other fields get a handler only while their value is
+// being parsed.
+class PlanHandlerBase : public BaseHandler
+{
+protected:
+    struct Frame
+    {
+        const nonpublic::ParsePlan* plan;
+        char* base;
+        // The field of the last key, or null if its value is to be skipped
+        const nonpublic::PlanField* current;
+        // Index of the first of this frame's flags in `parsed_fields`
+        std::size_t parsed_offset;
+        // Depth of objects nested in a skipped value
+        int skip_depth;
+    };
+
+protected:
+    // Looked up when parsing starts rather than on construction, because the plan of a recursive
+    // type is still being compiled when handlers nested in it are constructed
+    const nonpublic::ParsePlan* plan = nullptr;
+    char* m_base;
+    // Taken when this handler is built, and used for the handlers of its fields as well
+    mempool::ChunkAllocator* chunks;
+    std::vector<Frame> frames;
+    std::vector<char> parsed_fields;
+    // The handler of the current field, for types the plan does not read itself
+    BaseHandler* active = nullptr;
+    std::unique_ptr<std::max_align_t[]> active_storage;
+    // An `ObjectTypeHandler` used when there is no usable plan, or limits are configured
+    std::unique_ptr<BaseHandler> fallback;
+
+protected:
+    virtual const nonpublic::ParsePlan* get_plan() const = 0;
+    virtual std::unique_ptr<BaseHandler> make_fallback() const = 0;
+
+    void reset() override;
+
+private:
+    bool use_fallback();
+    bool precheck(const char* actual_type, const nonpublic::PlanField** field);
+    bool postcheck(bool success);
+    bool forward_fallback(bool success);
+    bool activate(const nonpublic::PlanField* field);
+    void deactivate();
+    bool set_parsed(const nonpublic::PlanField* field);
+    char* address_of(const nonpublic::PlanField* field) const
+    {
+        return frames.back().base + field->offset;
+    }
+    void push_frame(const nonpublic::ParsePlan* p, char* base);
+    void set_missing_required(const std::string& name);
+
+    static bool write_field(const nonpublic::PlanField& f,
+                            char* base,
+                            nonpublic::CompactSinkWriter& w,
+                            void* storage)
+    {
+        nonpublic::ScopedFieldHandler h(f.ops, base + f.offset, storage);
+        return f.ops->write_compact(h.get(), w);
+    }
+
+    static bool write_field(const nonpublic::PlanField& f,
+                            char* base,
+                            nonpublic::PrettySinkWriter& w,
+                            void* storage)
+    {
+        nonpublic::ScopedFieldHandler h(f.ops, base + f.offset, storage);
+        return f.ops->write_pretty(h.get(), w);
+    }
+
+    template <class Writer>
+    static bool write_field(const nonpublic::PlanField& f, char* base, Writer& w, void* storage)
+    {
+        nonpublic::ScopedFieldHandler h(f.ops, base + f.offset, storage);
+        return nonpublic::write_virtual(*h.get(), w);
+    }
+
+    template <class Writer>
+    bool write_object_to(const nonpublic::ParsePlan& p, char* base, Writer& w, void* storage) const
+    {
+        SizeType count = 0;
+        if (!w.StartObject())
+            return false;
+        for (const nonpublic::PlanField& f : p.fields)
+        {
+            if (f.flags & Flags::IgnoreWrite)
+                continue;
+            if (!nonpublic::write_quoted_key(
+                    w, f.name, f.name_length, f.quoted_name, f.quoted_name_length))
+                return false;
+            if (f.sub_plan ? !write_object_to(*f.sub_plan, base + f.offset, w, storage)
+                           : !write_field(f, base, w, storage))
+                return false;
+            ++count;
+        }
+        return w.EndObject(count);
+    }
+
+public:
+    explicit PlanHandlerBase(void* base)
+        : m_base(static_cast<char*>(base)), chunks(mempool::current_chunk_allocator())
+    {
+    }
+
+    ~PlanHandlerBase();
+
+    std::string type_name() const override { return "object"; }
+
+    bool Null() override;
+
+    bool Bool(bool) override;
+
+    bool Int(int) override;
+
+    bool Uint(unsigned) override;
+
+    bool Int64(std::int64_t) override;
+
+    bool Uint64(std::uint64_t) override;
+
+    bool Double(double) override;
+
+    bool String(const char*, SizeType, bool) override;
+
+    bool StartObject() override;
+
+    bool Key(const char*, SizeType, bool) override;
+
+    bool EndObject(SizeType) override;
+
+    bool StartArray() override;
+
+    bool EndArray(SizeType) override;
+
+    bool has_error() const override;
+
+    void describe_footprint(FootprintNode& node) const override;
+
+    bool reap_error(ErrorStack&) override;
+
+    bool write(IHandler* output) const override;
+
+    template <class Writer>
+    bool write_to(Writer& w) const
+    {
+        const nonpublic::ParsePlan* p = get_plan();
+        if (!p)
+            return nonpublic::write_static(*make_fallback(), w);
+        nonpublic::HandlerStorage storage(p->max_handler_size);
+        return write_object_to(*p, m_base, w, storage.get());
+    }
+
+    void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override;
+};
+
+template <class T>
+class PlanHandler : public PlanHandlerBase
+{
+private:
+    T* value() const { return static_cast<T*>(static_cast<void*>(m_base)); }
+
+protected:
+    const nonpublic::ParsePlan* get_plan() const override
+    {
+        return nonpublic::parse_plan_of(value());
+    }
+
+    std::unique_ptr<BaseHandler> make_fallback() const override
+    {
+        return std::unique_ptr<BaseHandler>(new ObjectTypeHandler<T>(value()));
+    }
+
+public:
+    explicit PlanHandler(T* t) : PlanHandlerBase(t) {}
+};
+}
+
+// Parses and serializes `type` through a parse plan compiled once from its registered fields. The
+// type, and the registered structs it holds by value, must register the same members for every
+// instance. If a registered member lies outside the object, no plan is compiled and the type is
+// handled like any other struct.
+#define STATICJSON_DECLARE_PARSE_PLAN(type)                                                        \
+    namespace staticjson                                                                           \
+    {                                                                                              \
+        template <>                                                                                \
+        class Handler<type> : public PlanHandler<type>                                             \
+        {                                                                                          \
+        public:                                                                                    \
+            explicit Handler(type* value) : PlanHandler<type>(value) {}                            \
+        };                                                                                         \
+    }
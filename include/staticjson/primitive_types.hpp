@@ -66,14 +66,21 @@ public:
     bool Double(double d) override { return receive(d, "double"); }
 
     bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
     {
         if (std::numeric_limits<IntType>::is_signed)
         {
-            return output->Int64(*m_value);
+            return w.Int64(*m_value);
         }
         else
         {
-            return output->Uint64(*m_value);
+            return w.Uint64(*m_value);
         }
     }
 
@@ -111,7 +118,14 @@ public:
 
     std::string type_name() const override { return "null"; }
 
-    bool write(IHandler* output) const override { return output->Null(); }
+    bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return w.Null(); }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
     {
@@ -138,7 +152,14 @@ public:
 
     std::string type_name() const override { return "bool"; }
 
-    bool write(IHandler* output) const override { return output->Bool(*m_value); }
+    bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return w.Bool(*m_value); }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
     {
@@ -155,7 +176,14 @@ public:
 
     std::string type_name() const override { return "int"; }
 
-    bool write(IHandler* output) const override { return output->Int(*m_value); }
+    bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return w.Int(*m_value); }
 };
 
 template <>
@@ -166,7 +194,88 @@ public:
 
     std::string type_name() const override { return "unsigned int"; }
 
-    bool write(IHandler* output) const override { return output->Uint(*m_value); }
+    bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return w.Uint(*m_value); }
+};
+
+// Narrow integers, such as `std::int16_t` and `std::uint8_t`, are checked against their range.
+// Plain `char` is handled as a boolean below.
+template <>
+class Handler<short> : public IntegerHandler<short>
+{
+public:
+    explicit Handler(short* i) : IntegerHandler<short>(i) {}
+
+    std::string type_name() const override { return "short"; }
+
+    bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return w.Int(*m_value); }
+};
+
+template <>
+class Handler<unsigned short> : public IntegerHandler<unsigned short>
+{
+public:
+    explicit Handler(unsigned short* i) : IntegerHandler<unsigned short>(i) {}
+
+    std::string type_name() const override { return "unsigned short"; }
+
+    bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return w.Uint(*m_value); }
+};
+
+template <>
+class Handler<signed char> : public IntegerHandler<signed char>
+{
+public:
+    explicit Handler(signed char* i) : IntegerHandler<signed char>(i) {}
+
+    std::string type_name() const override { return "signed char"; }
+
+    bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return w.Int(*m_value); }
+};
+
+template <>
+class Handler<unsigned char> : public IntegerHandler<unsigned char>
+{
+public:
+    explicit Handler(unsigned char* i) : IntegerHandler<unsigned char>(i) {}
+
+    std::string type_name() const override { return "unsigned char"; }
+
+    bool write(IHandler* output) const override
+    {
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return w.Uint(*m_value); }
 };
 
 template <>
@@ -224,7 +333,14 @@ public:
         return true;
     }
 
-    bool write(IHandler* out) const override { return out->Bool(*m_value != 0); }
+    bool write(IHandler* out) const override
+    {
+        nonpublic::IHandlerWriter w(out);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return w.Bool(*m_value != 0); }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
     {
@@ -283,7 +399,14 @@ public:
 
     std::string type_name() const override { return "double"; }
 
-    bool write(IHandler* out) const override { return out->Double(*m_value); }
+    bool write(IHandler* out) const override
+    {
+        nonpublic::IHandlerWriter w(out);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return w.Double(*m_value); }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
     {
@@ -346,7 +469,14 @@ public:
 
     std::string type_name() const override { return "float"; }
 
-    bool write(IHandler* out) const override { return out->Double(*m_value); }
+    bool write(IHandler* out) const override
+    {
+        nonpublic::IHandlerWriter w(out);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const { return nonpublic::write_float(w, *m_value); }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
     {
@@ -355,18 +485,25 @@ public:
     }
 };
 
-template <>
-class Handler<std::string> : public BaseHandler
+// Also covers strings with other allocators, such as `std::pmr::string`
+template <class Alloc>
+class Handler<std::basic_string<char, std::char_traits<char>, Alloc>> : public BaseHandler
 {
 private:
-    std::string* m_value;
+    typedef std::basic_string<char, std::char_traits<char>, Alloc> string_type;
+
+    string_type* m_value;
 
 public:
-    explicit Handler(std::string* v) : m_value(v) {}
+    explicit Handler(string_type* v) : m_value(v) {}
 
     bool String(const char* str, SizeType length, bool) override
     {
+        std::size_t capacity = m_value->capacity();
         m_value->assign(str, length);
+        // Growing the capacity takes a new buffer
+        if (m_value->capacity() > capacity && !this->charge_memory(m_value->capacity() + 1))
+            return false;
         this->parsed = true;
         return true;
     }
@@ -375,7 +512,14 @@ public:
 
     bool write(IHandler* out) const override
     {
-        return out->String(m_value->data(), SizeType(m_value->size()), true);
+        nonpublic::IHandlerWriter w(out);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
+    {
+        return w.String(m_value->data(), SizeType(m_value->size()), true);
     }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
@@ -384,4 +528,89 @@ public:
         output.AddMember(rapidjson::StringRef("type"), rapidjson::StringRef("string"), alloc);
     }
 };
+
+// A string that refers to characters owned elsewhere, either the input of `from_json_insitu` or
+// the active `StringArena`.
+struct StringSlice
+{
+    const char* data;
+    std::size_t size;
+
+    StringSlice() : data(""), size(0) {}
+    StringSlice(const char* data, std::size_t size) : data(data), size(size) {}
+};
+
+namespace nonpublic
+{
+    // Where a view field may point for a string received with `copy`, or null if nowhere
+    const char* reference_string(const char* str, SizeType length, bool copy);
+}
+
+// Parses into a view type constructible from a pointer and a length, without copying the
+// characters if they stay valid after the parse. Otherwise they are copied into the active
+// `StringArena`, and parsing fails if there is none.
+template <class View>
+class StringViewHandler : public BaseHandler
+{
+private:
+    View* m_value;
+
+    static const char* data_of(const StringSlice& s) { return s.data; }
+    static std::size_t size_of(const StringSlice& s) { return s.size; }
+
+    template <class V>
+    static const char* data_of(const V& v)
+    {
+        return v.data();
+    }
+    template <class V>
+    static std::size_t size_of(const V& v)
+    {
+        return v.size();
+    }
+
+public:
+    explicit StringViewHandler(View* v) : m_value(v) {}
+
+    bool String(const char* str, SizeType length, bool copy) override
+    {
+        const char* data = nonpublic::reference_string(str, length, copy);
+        if (!data)
+        {
+            the_error.reset(new error::CustomError(
+                "string views need in situ parsing or an active StringArena"));
+            return false;
+        }
+        *m_value = View(data, length);
+        this->parsed = true;
+        return true;
+    }
+
+    std::string type_name() const override { return "string"; }
+
+    bool write(IHandler* out) const override
+    {
+        nonpublic::IHandlerWriter w(out);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
+    {
+        return w.String(data_of(*m_value), SizeType(size_of(*m_value)), true);
+    }
+
+    void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
+    {
+        output.SetObject();
+        output.AddMember(rapidjson::StringRef("type"), rapidjson::StringRef("string"), alloc);
+    }
+};
+
+template <>
+class Handler<StringSlice> : public StringViewHandler<StringSlice>
+{
+public:
+    explicit Handler(StringSlice* v) : StringViewHandler<StringSlice>(v) {}
+};
 }
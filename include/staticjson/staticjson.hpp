@@ -2,6 +2,10 @@
 #include <staticjson/basic.hpp>
 #include <staticjson/document.hpp>
 #include <staticjson/enum.hpp>
+#include <staticjson/field_table.hpp>
+#include <staticjson/footprint.hpp>
+#include <staticjson/interned_string.hpp>
 #include <staticjson/io.hpp>
+#include <staticjson/parse_plan.hpp>
 #include <staticjson/primitive_types.hpp>
 #include <staticjson/stl_types.hpp>
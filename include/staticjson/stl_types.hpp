@@ -1,8 +1,11 @@
 #pragma once
 #include <staticjson/basic.hpp>
 
+#include <algorithm>
 #include <array>
 #include <deque>
+#include <functional>
+#include <iterator>
 #include <list>
 #include <map>
 #include <memory>
@@ -12,31 +15,117 @@
 
 namespace staticjson
 {
+namespace nonpublic
+{
+    // Makes an element for a container with allocator `alloc`, passing the allocator on if the
+    // element uses one, so that it can later be moved into the container without a copy.
+    template <class T, class Alloc>
+    typename std::enable_if<std::uses_allocator<T, Alloc>::value
+                                && std::is_constructible<T, const Alloc&>::value,
+                            T>::type
+    make_element(const Alloc& alloc)
+    {
+        return T(alloc);
+    }
+
+    template <class T, class Alloc>
+    typename std::enable_if<!(std::uses_allocator<T, Alloc>::value
+                              && std::is_constructible<T, const Alloc&>::value),
+                            T>::type
+    make_element(const Alloc&)
+    {
+        return T();
+    }
+
+    // Reserves room for `n` elements in containers that support it
+    template <class C>
+    auto reserve_capacity(C& c, std::size_t n, int) -> decltype(c.reserve(n), void())
+    {
+        c.reserve(n);
+    }
+
+    template <class C>
+    void reserve_capacity(C&, std::size_t, long)
+    {
+    }
+
+    template <class C>
+    void reserve_capacity(C& c, std::size_t n)
+    {
+        if (n)
+            reserve_capacity(c, n, 0);
+    }
+}
+
+// While active on this thread, parsing into a sequence container or a map with unique keys
+// overwrites the elements it already holds, so that the memory they own is reused, instead of
+// clearing it first. Surplus elements, and map entries whose keys are absent, are removed at
+// the end. Fields missing from the new document keep their previous values, as when parsing into
+// an existing object.
+class ReparseScope
+{
+private:
+    bool previous;
+
+public:
+    ReparseScope() noexcept;
+    ReparseScope(const ReparseScope&) = delete;
+    ReparseScope& operator=(const ReparseScope&) = delete;
+    ~ReparseScope();
+
+    static bool active() noexcept;
+};
+
 template <class ArrayType>
 class ArrayHandler : public BaseHandler
 {
 public:
     typedef typename ArrayType::value_type ElementType;
+    typedef Handler<ElementType> internal_type;
 
 protected:
     ElementType element;
     Handler<ElementType> internal;
     ArrayType* m_value;
     int depth = 0;
+    std::size_t capacity_hint = 0;
+    // The size parsed last time, when learning
+    std::size_t learned_size = 0;
+    bool learn_capacity = false;
+    // When reparsing in place, the next existing element to overwrite
+    typename ArrayType::iterator reused;
+    bool reusing = false;
+    bool element_started = false;
 
 protected:
-    void set_element_error() { the_error.reset(new error::ArrayElementError(m_value->size())); }
+    void set_element_error()
+    {
+        std::size_t index = reusing
+            ? static_cast<std::size_t>(std::distance(m_value->begin(), reused))
+            : m_value->size();
+        the_error.reset(new error::ArrayElementError(index));
+    }
 
     bool precheck(const char* type)
     {
         if (depth <= 0)
         {
-            the_error.reset(new error::TypeMismatchError(type_name(), type));
-            return false;
+            return set_type_mismatch(type);
         }
+        begin_element();
         return true;
     }
 
+    // Moves the existing element to be overwritten into `element`, with everything it owns
+    void begin_element()
+    {
+        if (!reusing || element_started)
+            return;
+        element_started = true;
+        if (reused != m_value->end())
+            element = std::move(*reused);
+    }
+
     bool postcheck(bool success)
     {
         if (!success)
@@ -46,67 +135,113 @@ protected:
         }
         if (internal.is_parsed())
         {
-            m_value->emplace_back(std::move(element));
-            element = ElementType();
+            if (reusing && reused != m_value->end())
+            {
+                *reused = std::move(element);
+                ++reused;
+            }
+            else
+            {
+                m_value->emplace_back(std::move(element));
+                if (reusing)
+                    reused = m_value->end();
+                if (!charge_memory(sizeof(ElementType)))
+                    return false;
+            }
+            element_started = false;
+            element = new_element();
             internal.prepare_for_reuse();
         }
         return true;
     }
 
+    ElementType new_element() const
+    {
+        return nonpublic::make_element<ElementType>(m_value->get_allocator());
+    }
+
     void reset() override
     {
-        element = ElementType();
+        element = new_element();
         internal.prepare_for_reuse();
         depth = 0;
+        reusing = false;
+        element_started = false;
     }
 
 public:
-    explicit ArrayHandler(ArrayType* value) : element(), internal(&element), m_value(value) {}
+    explicit ArrayHandler(ArrayType* value)
+        : element(nonpublic::make_element<ElementType>(value->get_allocator()))
+        , internal(&element)
+        , m_value(value)
+    {
+    }
 
-    bool Null() override { return precheck("null") && postcheck(internal.Null()); }
+    bool Null() override { return precheck("null") && postcheck(internal.internal_type::Null()); }
 
-    bool Bool(bool b) override { return precheck("bool") && postcheck(internal.Bool(b)); }
+    bool Bool(bool b) override
+    {
+        return precheck("bool") && postcheck(internal.internal_type::Bool(b));
+    }
 
-    bool Int(int i) override { return precheck("int") && postcheck(internal.Int(i)); }
+    bool Int(int i) override
+    {
+        return precheck("int") && postcheck(internal.internal_type::Int(i));
+    }
 
-    bool Uint(unsigned i) override { return precheck("unsigned") && postcheck(internal.Uint(i)); }
+    bool Uint(unsigned i) override
+    {
+        return precheck("unsigned") && postcheck(internal.internal_type::Uint(i));
+    }
 
     bool Int64(std::int64_t i) override
     {
-        return precheck("int64_t") && postcheck(internal.Int64(i));
+        return precheck("int64_t") && postcheck(internal.internal_type::Int64(i));
     }
 
     bool Uint64(std::uint64_t i) override
     {
-        return precheck("uint64_t") && postcheck(internal.Uint64(i));
+        return precheck("uint64_t") && postcheck(internal.internal_type::Uint64(i));
     }
 
-    bool Double(double d) override { return precheck("double") && postcheck(internal.Double(d)); }
+    bool Double(double d) override
+    {
+        return precheck("double") && postcheck(internal.internal_type::Double(d));
+    }
 
     bool String(const char* str, SizeType length, bool copy) override
     {
-        return precheck("string") && postcheck(internal.String(str, length, copy));
+        return precheck("string") && postcheck(internal.internal_type::String(str, length, copy));
     }
 
     bool Key(const char* str, SizeType length, bool copy) override
     {
-        return precheck("object") && postcheck(internal.Key(str, length, copy));
+        return precheck("object") && postcheck(internal.internal_type::Key(str, length, copy));
     }
 
-    bool StartObject() override { return precheck("object") && postcheck(internal.StartObject()); }
+    bool StartObject() override
+    {
+        return precheck("object") && postcheck(internal.internal_type::StartObject());
+    }
 
     bool EndObject(SizeType length) override
     {
-        return precheck("object") && postcheck(internal.EndObject(length));
+        return precheck("object") && postcheck(internal.internal_type::EndObject(length));
     }
 
     bool StartArray() override
     {
         ++depth;
         if (depth > 1)
-            return postcheck(internal.StartArray());
-        else
+        {
+            begin_element();
+            return postcheck(internal.internal_type::StartArray());
+        }
+        reusing = ReparseScope::active();
+        if (!reusing)
             m_value->clear();
+        nonpublic::reserve_capacity(*m_value, std::max(capacity_hint, learned_size));
+        reused = m_value->begin();
         return true;
     }
 
@@ -116,12 +251,35 @@ public:
 
         // When depth >= 1, this event should be forwarded to the element
         if (depth > 0)
-            return postcheck(internal.EndArray(length));
+            return postcheck(internal.internal_type::EndArray(length));
 
+        if (reusing)
+            m_value->erase(reused, m_value->end());
+        if (learn_capacity)
+            learned_size = m_value->size();
         this->parsed = true;
         return true;
     }
 
+    void set_capacity_hint(std::size_t count, bool learn) override
+    {
+        capacity_hint = count;
+        learn_capacity = learn;
+        // Nested containers are parsed by the same element handler again and again
+        internal.set_capacity_hint(0, learn);
+    }
+
+    nonpublic::TypeNameRenderer type_name_renderer() const override
+    {
+        return nonpublic::type_name_renderer_of<ArrayType>();
+    }
+
+    void describe_footprint(FootprintNode& node) const override
+    {
+        node.split("scratch element", sizeof(ElementType));
+        nonpublic::describe_handler(node.split("element handler", sizeof(internal_type)), internal);
+    }
+
     bool reap_error(ErrorStack& stk) override
     {
         if (!the_error)
@@ -133,15 +291,22 @@ public:
 
     bool write(IHandler* output) const override
     {
-        if (!output->StartArray())
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
+    {
+        if (!w.StartArray())
             return false;
         for (auto&& e : *m_value)
         {
             Handler<ElementType> h(&e);
-            if (!h.write(output))
+            if (!nonpublic::write_static(h, w))
                 return false;
         }
-        return output->EndArray(static_cast<staticjson::SizeType>(m_value->size()));
+        return w.EndArray(static_cast<staticjson::SizeType>(m_value->size()));
     }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
@@ -156,11 +321,11 @@ public:
     const Handler<ElementType>& get_internal_handler() const noexcept { return internal; }
 };
 
-template <class T>
-class Handler<std::vector<T>> : public ArrayHandler<std::vector<T>>
+template <class T, class Alloc>
+class Handler<std::vector<T, Alloc>> : public ArrayHandler<std::vector<T, Alloc>>
 {
 public:
-    explicit Handler(std::vector<T>* value) : ArrayHandler<std::vector<T>>(value) {}
+    explicit Handler(std::vector<T, Alloc>* value) : ArrayHandler<std::vector<T, Alloc>>(value) {}
 
     std::string type_name() const override
     {
@@ -168,11 +333,11 @@ public:
     }
 };
 
-template <class T>
-class Handler<std::deque<T>> : public ArrayHandler<std::deque<T>>
+template <class T, class Alloc>
+class Handler<std::deque<T, Alloc>> : public ArrayHandler<std::deque<T, Alloc>>
 {
 public:
-    explicit Handler(std::deque<T>* value) : ArrayHandler<std::deque<T>>(value) {}
+    explicit Handler(std::deque<T, Alloc>* value) : ArrayHandler<std::deque<T, Alloc>>(value) {}
 
     std::string type_name() const override
     {
@@ -180,11 +345,11 @@ public:
     }
 };
 
-template <class T>
-class Handler<std::list<T>> : public ArrayHandler<std::list<T>>
+template <class T, class Alloc>
+class Handler<std::list<T, Alloc>> : public ArrayHandler<std::list<T, Alloc>>
 {
 public:
-    explicit Handler(std::list<T>* value) : ArrayHandler<std::list<T>>(value) {}
+    explicit Handler(std::list<T, Alloc>* value) : ArrayHandler<std::list<T, Alloc>>(value) {}
 
     std::string type_name() const override
     {
@@ -195,6 +360,9 @@ public:
 template <class T, size_t N>
 class Handler<std::array<T, N>> : public BaseHandler
 {
+public:
+    typedef Handler<T> internal_type;
+
 protected:
     T element;
     Handler<T> internal;
@@ -211,8 +379,7 @@ protected:
     {
         if (depth <= 0)
         {
-            the_error.reset(new error::TypeMismatchError(type_name(), type));
-            return false;
+            return set_type_mismatch(type);
         }
         return true;
     }
@@ -250,48 +417,63 @@ protected:
 public:
     explicit Handler(std::array<T, N>* value) : element(), internal(&element), m_value(value) {}
 
-    bool Null() override { return precheck("null") && postcheck(internal.Null()); }
+    bool Null() override { return precheck("null") && postcheck(internal.internal_type::Null()); }
 
-    bool Bool(bool b) override { return precheck("bool") && postcheck(internal.Bool(b)); }
+    bool Bool(bool b) override
+    {
+        return precheck("bool") && postcheck(internal.internal_type::Bool(b));
+    }
 
-    bool Int(int i) override { return precheck("int") && postcheck(internal.Int(i)); }
+    bool Int(int i) override
+    {
+        return precheck("int") && postcheck(internal.internal_type::Int(i));
+    }
 
-    bool Uint(unsigned i) override { return precheck("unsigned") && postcheck(internal.Uint(i)); }
+    bool Uint(unsigned i) override
+    {
+        return precheck("unsigned") && postcheck(internal.internal_type::Uint(i));
+    }
 
     bool Int64(std::int64_t i) override
     {
-        return precheck("int64_t") && postcheck(internal.Int64(i));
+        return precheck("int64_t") && postcheck(internal.internal_type::Int64(i));
     }
 
     bool Uint64(std::uint64_t i) override
     {
-        return precheck("uint64_t") && postcheck(internal.Uint64(i));
+        return precheck("uint64_t") && postcheck(internal.internal_type::Uint64(i));
     }
 
-    bool Double(double d) override { return precheck("double") && postcheck(internal.Double(d)); }
+    bool Double(double d) override
+    {
+        return precheck("double") && postcheck(internal.internal_type::Double(d));
+    }
 
     bool String(const char* str, SizeType length, bool copy) override
     {
-        return precheck("string") && postcheck(internal.String(str, length, copy));
+        return precheck("string") && postcheck(internal.internal_type::String(str, length, copy));
     }
 
     bool Key(const char* str, SizeType length, bool copy) override
     {
-        return precheck("object") && postcheck(internal.Key(str, length, copy));
+        return precheck("object") && postcheck(internal.internal_type::Key(str, length, copy));
     }
 
-    bool StartObject() override { return precheck("object") && postcheck(internal.StartObject()); }
+    bool StartObject() override
+    {
+        return precheck("object") && postcheck(internal.internal_type::StartObject());
+    }
 
     bool EndObject(SizeType length) override
     {
-        return precheck("object") && postcheck(internal.EndObject(length));
+        return precheck("object") && postcheck(internal.internal_type::EndObject(length));
     }
 
     bool StartArray() override
     {
         ++depth;
         if (depth > 1)
-            return postcheck(internal.StartArray());
+            return postcheck(internal.internal_type::StartArray());
         return true;
     }
 
@@ -301,7 +483,7 @@ public:
 
         // When depth >= 1, this event should be forwarded to the element
         if (depth > 0)
-            return postcheck(internal.EndArray(length));
+            return postcheck(internal.internal_type::EndArray(length));
         if (count != N)
         {
             set_length_error();
@@ -322,15 +504,22 @@ public:
 
     bool write(IHandler* output) const override
     {
-        if (!output->StartArray())
+        nonpublic::IHandlerWriter w(output);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
+    {
+        if (!w.StartArray())
             return false;
         for (auto&& e : *m_value)
         {
             Handler<T> h(&e);
-            if (!h.write(output))
+            if (!nonpublic::write_static(h, w))
                 return false;
         }
-        return output->EndArray(static_cast<staticjson::SizeType>(m_value->size()));
+        return w.EndArray(static_cast<staticjson::SizeType>(m_value->size()));
     }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
@@ -348,6 +537,36 @@ public:
     {
         return "std::array<" + internal.type_name() + ", " + std::to_string(N) + ">";
     }
+
+    nonpublic::TypeNameRenderer type_name_renderer() const override
+    {
+        return nonpublic::type_name_renderer_of<std::array<T, N>>();
+    }
+
+    void describe_footprint(FootprintNode& node) const override
+    {
+        node.split("scratch element", sizeof(T));
+        nonpublic::describe_handler(node.split("element handler", sizeof(internal_type)), internal);
+    }
+};
+
+// Creates the object that a pointer points to before it is parsed. Specialize it to allocate
+// the pointees of a pointer type from somewhere other than the heap, e.g. for
+// `std::unique_ptr<T, D>` with a deleter `D` that returns them to a pool.
+template <class PointerType>
+struct PointeeFactory
+{
+    static void create(PointerType* p)
+    {
+        p->reset(new typename std::pointer_traits<PointerType>::element_type());
+    }
+};
+
+template <class T>
+struct PointeeFactory<std::shared_ptr<T>>
+{
+    // One allocation for both the object and its control block
+    static void create(std::shared_ptr<T>* p) { *p = std::make_shared<T>(); }
 };
 
 template <class PointerType>
@@ -355,22 +574,48 @@ class PointerHandler : public BaseHandler
 {
 public:
     typedef typename std::pointer_traits<PointerType>::element_type ElementType;
+    typedef Handler<ElementType> internal_type;
 
 protected:
     mutable PointerType* m_value;
-    mutable std::unique_ptr<Handler<ElementType>> internal_handler;
+    // Allocated from the active arena, where a recursive structure recycles the handlers of its
+    // nodes as they are finished with
+    mutable mempool::ChunkPtr<Handler<ElementType>> internal_handler;
+    // The pointee that `internal_handler` was created for
+    mutable ElementType* bound = nullptr;
+    // Taken when this handler is built, so that pointee handlers come from the same arena
+    mempool::ChunkAllocator* chunks;
     int depth = 0;
 
 protected:
-    explicit PointerHandler(PointerType* value) : m_value(value) {}
+    explicit PointerHandler(PointerType* value)
+        : m_value(value), chunks(mempool::current_chunk_allocator())
+    {
+    }
 
-    void initialize()
+    void bind() const
     {
-        if (!internal_handler)
+        ElementType* element = m_value->get();
+        if (internal_handler && bound == element)
         {
-            m_value->reset(new ElementType());
-            internal_handler.reset(new Handler<ElementType>(m_value->get()));
+            return;
         }
+        internal_handler.reset();
+        mempool::ChunkAllocatorScope chunk_scope(chunks);
+        internal_handler = mempool::chunk_new<Handler<ElementType>>(element);
+        bound = element;
+    }
+
+    bool initialize()
+    {
+        if (!internal_handler || bound != m_value->get())
+        {
+            PointeeFactory<PointerType>::create(m_value);
+            if (!this->charge_memory(sizeof(ElementType)))
+                return false;
+            bind();
+        }
+        return true;
     }
 
     void reset() override
@@ -398,22 +643,33 @@ public:
         }
         else
         {
-            initialize();
-            return postcheck(internal_handler->Null());
+            return initialize() && postcheck(internal_handler->internal_type::Null());
         }
     }
 
+    void describe_footprint(FootprintNode& node) const override
+    {
+        // Created when there is something to point to
+        if (internal_handler)
+            nonpublic::describe_handler(
+                node.add("pointee handler", sizeof(Handler<ElementType>)), *internal_handler);
+    }
+
     bool write(IHandler* out) const override
+    {
+        nonpublic::IHandlerWriter w(out);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
     {
         if (!m_value || !m_value->get())
         {
-            return out->Null();
-        }
-        if (!internal_handler)
-        {
-            internal_handler.reset(new Handler<ElementType>(m_value->get()));
+            return w.Null();
         }
-        return internal_handler->write(out);
+        bind();
+        return nonpublic::write_static(*internal_handler, w);
     }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
@@ -432,85 +688,86 @@ public:
 
     bool Bool(bool b) override
     {
-        initialize();
-        return postcheck(internal_handler->Bool(b));
+        return initialize() && postcheck(internal_handler->internal_type::Bool(b));
     }
 
     bool Int(int i) override
     {
-        initialize();
-        return postcheck(internal_handler->Int(i));
+        return initialize() && postcheck(internal_handler->internal_type::Int(i));
     }
 
     bool Uint(unsigned i) override
     {
-        initialize();
-        return postcheck(internal_handler->Uint(i));
+        return initialize() && postcheck(internal_handler->internal_type::Uint(i));
     }
 
     bool Int64(std::int64_t i) override
     {
-        initialize();
-        return postcheck(internal_handler->Int64(i));
+        return initialize() && postcheck(internal_handler->internal_type::Int64(i));
     }
 
     bool Uint64(std::uint64_t i) override
     {
-        initialize();
-        return postcheck(internal_handler->Uint64(i));
+        return initialize() && postcheck(internal_handler->internal_type::Uint64(i));
     }
 
     bool Double(double i) override
     {
-        initialize();
-        return postcheck(internal_handler->Double(i));
+        return initialize() && postcheck(internal_handler->internal_type::Double(i));
     }
 
     bool String(const char* str, SizeType len, bool copy) override
     {
-        initialize();
-        return postcheck(internal_handler->String(str, len, copy));
+        return initialize()
+            && postcheck(internal_handler->internal_type::String(str, len, copy));
     }
 
     bool Key(const char* str, SizeType len, bool copy) override
     {
-        initialize();
-        return postcheck(internal_handler->Key(str, len, copy));
+        return initialize() && postcheck(internal_handler->internal_type::Key(str, len, copy));
     }
 
     bool StartObject() override
     {
-        initialize();
+        if (!initialize())
+            return false;
         ++depth;
-        return internal_handler->StartObject();
+        return internal_handler->internal_type::StartObject();
     }
 
     bool EndObject(SizeType len) override
     {
-        initialize();
+        if (!initialize())
+            return false;
         --depth;
-        return postcheck(internal_handler->EndObject(len));
+        return postcheck(internal_handler->internal_type::EndObject(len));
     }
 
     bool StartArray() override
     {
-        initialize();
+        if (!initialize())
+            return false;
         ++depth;
-        return postcheck(internal_handler->StartArray());
+        return postcheck(internal_handler->internal_type::StartArray());
     }
 
     bool EndArray(SizeType len) override
     {
-        initialize();
+        if (!initialize())
+            return false;
         --depth;
-        return postcheck(internal_handler->EndArray(len));
+        return postcheck(internal_handler->internal_type::EndArray(len));
     }
 
-    bool has_error() const override { return internal_handler && internal_handler->has_error(); }
+    bool has_error() const override
+    {
+        return BaseHandler::has_error() || (internal_handler && internal_handler->has_error());
+    }
 
     bool reap_error(ErrorStack& stk) override
     {
-        return internal_handler && internal_handler->reap_error(stk);
+        return BaseHandler::reap_error(stk)
+            || (internal_handler && internal_handler->reap_error(stk));
     }
 };
 
@@ -549,26 +806,224 @@ public:
     }
 };
 
+namespace nonpublic
+{
+    // Keys of the maps that can be parsed, `std::string` with any allocator
+    template <class Alloc>
+    using KeyString = std::basic_string<char, std::char_traits<char>, Alloc>;
+
+    template <class MapType>
+    struct has_unique_keys : std::false_type
+    {
+    };
+
+    template <class K, class T, class Compare, class Alloc>
+    struct has_unique_keys<std::map<K, T, Compare, Alloc>> : std::true_type
+    {
+    };
+
+    template <class K, class T, class Hash, class Equal, class Alloc>
+    struct has_unique_keys<std::unordered_map<K, T, Hash, Equal, Alloc>> : std::true_type
+    {
+    };
+
+    // A set of addresses that keeps its memory when cleared, for the entries of a map written
+    // while reparsing it in place
+    class AddressSet
+    {
+    private:
+        std::vector<const void*> slots;
+        std::size_t count = 0;
+
+        void grow();
+
+    public:
+        // False if `address` was in the set already
+        bool insert(const void* address);
+        bool contains(const void* address) const noexcept;
+        void clear() noexcept;
+
+        std::size_t size() const noexcept { return count; }
+        std::size_t capacity() const noexcept { return slots.capacity(); }
+    };
+
+    // The value of `key`, inserted as `element` if absent, in which case `inserted` is set. Only
+    // maps with unique keys are reparsed in place.
+    template <class MapType, class E>
+    typename MapType::mapped_type* find_or_insert(MapType& m,
+                                                  const typename MapType::key_type& key,
+                                                  E&& element,
+                                                  bool* inserted,
+                                                  std::true_type)
+    {
+        auto it = m.find(key);
+        *inserted = it == m.end();
+        if (*inserted)
+            it = m.emplace(key, std::forward<E>(element)).first;
+        return &it->second;
+    }
+
+    template <class MapType, class E>
+    typename MapType::mapped_type*
+    find_or_insert(MapType&, const typename MapType::key_type&, E&&, bool*, std::false_type)
+    {
+        return nullptr;
+    }
+
+    // Removes the entry of `key` whose value is `value`
+    template <class MapType>
+    void erase_map_entry(MapType& m,
+                         const typename MapType::key_type& key,
+                         const typename MapType::mapped_type*,
+                         std::true_type)
+    {
+        m.erase(key);
+    }
+
+    template <class MapType>
+    void erase_map_entry(MapType& m,
+                         const typename MapType::key_type& key,
+                         const typename MapType::mapped_type* value,
+                         std::false_type)
+    {
+        auto range = m.equal_range(key);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (&it->second == value)
+            {
+                m.erase(it);
+                return;
+            }
+        }
+    }
+
+    // Creates the entry of `key` as soon as its value starts, with the key copied into the node
+    // straight from the buffer it was read into, and returns its value; or null if a map with
+    // unique keys already has the key, whose first value is kept. Ordered maps are searched once
+    // and then given the position found as a hint, so that sorted input such as our own output
+    // is inserted in constant time. A duplicate key allocates no node.
+    template <class K, class T, class Compare, class Alloc, class E>
+    T* emplace_map_entry(std::map<K, T, Compare, Alloc>& m, const K& key, E&& element)
+    {
+        auto it = m.lower_bound(key);
+        if (it != m.end() && !m.key_comp()(key, it->first))
+            return nullptr;
+        return &m.emplace_hint(it, key, std::forward<E>(element))->second;
+    }
+
+    template <class K, class T, class Compare, class Alloc, class E>
+    T* emplace_map_entry(std::multimap<K, T, Compare, Alloc>& m, const K& key, E&& element)
+    {
+        return &m.emplace_hint(m.end(), key, std::forward<E>(element))->second;
+    }
+
+    template <class K, class T, class Hash, class Equal, class Alloc, class E>
+    T* emplace_map_entry(std::unordered_map<K, T, Hash, Equal, Alloc>& m,
+                         const K& key,
+                         E&& element)
+    {
+        if (m.find(key) != m.end())
+            return nullptr;
+        return &m.emplace(key, std::forward<E>(element)).first->second;
+    }
+
+    template <class K, class T, class Hash, class Equal, class Alloc, class E>
+    T* emplace_map_entry(std::unordered_multimap<K, T, Hash, Equal, Alloc>& m,
+                         const K& key,
+                         E&& element)
+    {
+        return &m.emplace(key, std::forward<E>(element))->second;
+    }
+}
+
 template <class MapType>
 class MapHandler : public BaseHandler
 {
 protected:
+    typedef typename MapType::key_type KeyType;
     typedef typename MapType::mapped_type ElementType;
+    typedef Handler<ElementType> internal_type;
 
 protected:
     ElementType element;
     Handler<ElementType> internal_handler;
     MapType* m_value;
-    std::string current_key;
+    KeyType current_key;
+    // Number of keys seen in the object being parsed
+    std::size_t key_count = 0;
     int depth = 0;
+    std::size_t capacity_hint = 0;
+    // The size parsed last time, when learning
+    std::size_t learned_size = 0;
+    bool learn_capacity = false;
+    // The entry of the current key, whose value is parsed in `element` and moved back when
+    // complete. Null for a duplicate key, whose value is parsed and dropped.
+    ElementType* target = nullptr;
+    // Whether `target` was created for this value, and so is removed again if the value fails
+    bool inserted = false;
+    bool in_element = false;
+    // When reparsing in place, the entries whose keys were seen so far
+    nonpublic::AddressSet touched;
+    bool reusing = false;
 
 protected:
+    // Creates the entry of the current key when its value starts. When reparsing, the existing
+    // value of the key is moved into `element` to be overwritten.
+    bool begin_element()
+    {
+        if (in_element)
+            return true;
+        in_element = true;
+        if (reusing)
+        {
+            target = nonpublic::find_or_insert(*m_value,
+                                               current_key,
+                                               new_element(),
+                                               &inserted,
+                                               nonpublic::has_unique_keys<MapType>());
+            // Like a fresh parse, keep the first value of a duplicate key
+            if (!touched.insert(target))
+                target = nullptr;
+            else
+                element = std::move(*target);
+            return true;
+        }
+        target = nonpublic::emplace_map_entry(*m_value, current_key, new_element());
+        inserted = target != nullptr;
+        if (!target
+            || this->charge_memory(sizeof(typename MapType::value_type) + current_key.size()))
+            return true;
+        abandon_element();
+        return false;
+    }
+
+    // Removes the entries whose keys were absent from the document
+    void erase_untouched()
+    {
+        for (auto it = m_value->begin(); it != m_value->end();)
+        {
+            if (touched.contains(&it->second))
+                ++it;
+            else
+                it = m_value->erase(it);
+        }
+    }
+
+    ElementType new_element() const
+    {
+        return nonpublic::make_element<ElementType>(m_value->get_allocator());
+    }
+
     void reset() override
     {
-        element = ElementType();
+        element = new_element();
         current_key.clear();
         internal_handler.prepare_for_reuse();
         depth = 0;
+        target = nullptr;
+        inserted = false;
+        in_element = false;
+        reusing = false;
     }
 
     bool precheck(const char* type)
@@ -578,21 +1033,43 @@ protected:
             set_type_mismatch(type);
             return false;
         }
-        return true;
+        return begin_element();
+    }
+
+    // Leaves the map as it was before the value of the current key started
+    void abandon_element()
+    {
+        if (!target)
+            return;
+        if (inserted)
+            nonpublic::erase_map_entry(
+                *m_value, current_key, target, nonpublic::has_unique_keys<MapType>());
+        else
+            *target = std::move(element);
+        target = nullptr;
+        inserted = false;
+        in_element = false;
     }
 
     bool postcheck(bool success)
     {
         if (!success)
         {
-            the_error.reset(new error::ObjectMemberError(current_key));
+            abandon_element();
+            the_error.reset(new error::ObjectMemberError(
+                std::string(current_key.data(), nonpublic::detail_length(current_key.size())),
+                key_count - 1));
         }
         else
         {
             if (internal_handler.is_parsed())
             {
-                m_value->emplace(std::move(current_key), std::move(element));
-                element = ElementType();
+                if (target)
+                    *target = std::move(element);
+                target = nullptr;
+                inserted = false;
+                in_element = false;
+                element = new_element();
                 internal_handler.prepare_for_reuse();
             }
         }
@@ -600,65 +1077,87 @@ protected:
     }
 
 public:
-    explicit MapHandler(MapType* value) : element(), internal_handler(&element), m_value(value) {}
+    explicit MapHandler(MapType* value)
+        : element(nonpublic::make_element<ElementType>(value->get_allocator()))
+        , internal_handler(&element)
+        , m_value(value)
+        , current_key(nonpublic::make_element<KeyType>(value->get_allocator()))
+    {
+    }
 
-    bool Null() override { return precheck("null") && postcheck(internal_handler.Null()); }
+    bool Null() override
+    {
+        return precheck("null") && postcheck(internal_handler.internal_type::Null());
+    }
 
-    bool Bool(bool b) override { return precheck("bool") && postcheck(internal_handler.Bool(b)); }
+    bool Bool(bool b) override
+    {
+        return precheck("bool") && postcheck(internal_handler.internal_type::Bool(b));
+    }
 
-    bool Int(int i) override { return precheck("int") && postcheck(internal_handler.Int(i)); }
+    bool Int(int i) override
+    {
+        return precheck("int") && postcheck(internal_handler.internal_type::Int(i));
+    }
 
     bool Uint(unsigned i) override
     {
-        return precheck("unsigned") && postcheck(internal_handler.Uint(i));
+        return precheck("unsigned") && postcheck(internal_handler.internal_type::Uint(i));
     }
 
     bool Int64(std::int64_t i) override
     {
-        return precheck("int64_t") && postcheck(internal_handler.Int64(i));
+        return precheck("int64_t") && postcheck(internal_handler.internal_type::Int64(i));
     }
 
     bool Uint64(std::uint64_t i) override
     {
-        return precheck("uint64_t") && postcheck(internal_handler.Uint64(i));
+        return precheck("uint64_t") && postcheck(internal_handler.internal_type::Uint64(i));
     }
 
     bool Double(double d) override
     {
-        return precheck("double") && postcheck(internal_handler.Double(d));
+        return precheck("double") && postcheck(internal_handler.internal_type::Double(d));
     }
 
     bool String(const char* str, SizeType length, bool copy) override
     {
-        return precheck("string") && postcheck(internal_handler.String(str, length, copy));
+        return precheck("string")
+            && postcheck(internal_handler.internal_type::String(str, length, copy));
     }
 
     bool Key(const char* str, SizeType length, bool copy) override
     {
         if (depth > 1)
-            return postcheck(internal_handler.Key(str, length, copy));
+            return postcheck(internal_handler.internal_type::Key(str, length, copy));
 
         current_key.assign(str, length);
+        ++key_count;
         return true;
     }
 
     bool StartArray() override
     {
-        return precheck("array") && postcheck(internal_handler.StartArray());
+        return precheck("array") && postcheck(internal_handler.internal_type::StartArray());
     }
 
     bool EndArray(SizeType length) override
     {
-        return precheck("array") && postcheck(internal_handler.EndArray(length));
+        return precheck("array") && postcheck(internal_handler.internal_type::EndArray(length));
     }
 
     bool StartObject() override
     {
         ++depth;
         if (depth > 1)
-            return postcheck(internal_handler.StartObject());
+            return begin_element() && postcheck(internal_handler.internal_type::StartObject());
+        key_count = 0;
+        reusing = nonpublic::has_unique_keys<MapType>::value && ReparseScope::active();
+        if (reusing)
+            touched.clear();
         else
             m_value->clear();
+        nonpublic::reserve_capacity(*m_value, std::max(capacity_hint, learned_size));
         return true;
     }
 
@@ -666,11 +1165,37 @@ public:
     {
         --depth;
         if (depth > 0)
-            return postcheck(internal_handler.EndObject(length));
+            return postcheck(internal_handler.internal_type::EndObject(length));
+        if (reusing)
+            erase_untouched();
+        if (learn_capacity)
+            learned_size = m_value->size();
         this->parsed = true;
         return true;
     }
 
+    void set_capacity_hint(std::size_t count, bool learn) override
+    {
+        capacity_hint = count;
+        learn_capacity = learn;
+        internal_handler.set_capacity_hint(0, learn);
+    }
+
+    nonpublic::TypeNameRenderer type_name_renderer() const override
+    {
+        return nonpublic::type_name_renderer_of<MapType>();
+    }
+
+    void describe_footprint(FootprintNode& node) const override
+    {
+        node.split("scratch element", sizeof(ElementType));
+        node.split("key buffer", sizeof(KeyType));
+        if (touched.capacity())
+            node.add("reparsed entries", touched.capacity() * sizeof(const void*));
+        nonpublic::describe_handler(node.split("element handler", sizeof(internal_type)),
+                                    internal_handler);
+    }
+
     bool reap_error(ErrorStack& errs) override
     {
         if (!this->the_error)
@@ -683,17 +1208,24 @@ public:
 
     bool write(IHandler* out) const override
     {
-        if (!out->StartObject())
+        nonpublic::IHandlerWriter w(out);
+        return write_to(w);
+    }
+
+    template <class Writer>
+    bool write_to(Writer& w) const
+    {
+        if (!w.StartObject())
             return false;
         for (auto&& pair : *m_value)
         {
-            if (!out->Key(pair.first.data(), static_cast<SizeType>(pair.first.size()), true))
+            if (!w.Key(pair.first.data(), static_cast<SizeType>(pair.first.size()), true))
                 return false;
             Handler<ElementType> h(&pair.second);
-            if (!h.write(out))
+            if (!nonpublic::write_static(h, w))
                 return false;
         }
-        return out->EndObject(static_cast<SizeType>(m_value->size()));
+        return w.EndObject(static_cast<SizeType>(m_value->size()));
     }
 
     void generate_schema(Value& output, MemoryPoolAllocator& alloc) const override
@@ -709,13 +1241,14 @@ public:
     }
 };
 
-template <class T, class Hash, class Equal>
-class Handler<std::unordered_map<std::string, T, Hash, Equal>>
-    : public MapHandler<std::unordered_map<std::string, T, Hash, Equal>>
+template <class KeyAlloc, class T, class Hash, class Equal, class Alloc>
+class Handler<std::unordered_map<nonpublic::KeyString<KeyAlloc>, T, Hash, Equal, Alloc>>
+    : public MapHandler<std::unordered_map<nonpublic::KeyString<KeyAlloc>, T, Hash, Equal, Alloc>>
 {
 public:
-    explicit Handler(std::unordered_map<std::string, T, Hash, Equal>* value)
-        : MapHandler<std::unordered_map<std::string, T, Hash, Equal>>(value)
+    explicit Handler(
+        std::unordered_map<nonpublic::KeyString<KeyAlloc>, T, Hash, Equal, Alloc>* value)
+        : Handler::MapHandler(value)
     {
     }
 
@@ -725,13 +1258,13 @@ public:
     }
 };
 
-template <class T, class Hash, class Equal>
-class Handler<std::map<std::string, T, Hash, Equal>>
-    : public MapHandler<std::map<std::string, T, Hash, Equal>>
+template <class KeyAlloc, class T, class Compare, class Alloc>
+class Handler<std::map<nonpublic::KeyString<KeyAlloc>, T, Compare, Alloc>>
+    : public MapHandler<std::map<nonpublic::KeyString<KeyAlloc>, T, Compare, Alloc>>
 {
 public:
-    explicit Handler(std::map<std::string, T, Hash, Equal>* value)
-        : MapHandler<std::map<std::string, T, Hash, Equal>>(value)
+    explicit Handler(std::map<nonpublic::KeyString<KeyAlloc>, T, Compare, Alloc>* value)
+        : Handler::MapHandler(value)
     {
     }
 
@@ -741,13 +1274,15 @@ public:
     }
 };
 
-template <class T, class Hash, class Equal>
-class Handler<std::unordered_multimap<std::string, T, Hash, Equal>>
-    : public MapHandler<std::unordered_multimap<std::string, T, Hash, Equal>>
+template <class KeyAlloc, class T, class Hash, class Equal, class Alloc>
+class Handler<std::unordered_multimap<nonpublic::KeyString<KeyAlloc>, T, Hash, Equal, Alloc>>
+    : public MapHandler<
+          std::unordered_multimap<nonpublic::KeyString<KeyAlloc>, T, Hash, Equal, Alloc>>
 {
 public:
-    explicit Handler(std::unordered_multimap<std::string, T, Hash, Equal>* value)
-        : MapHandler<std::unordered_multimap<std::string, T, Hash, Equal>>(value)
+    explicit Handler(
+        std::unordered_multimap<nonpublic::KeyString<KeyAlloc>, T, Hash, Equal, Alloc>* value)
+        : Handler::MapHandler(value)
     {
     }
 
@@ -757,13 +1292,13 @@ public:
     }
 };
 
-template <class T, class Hash, class Equal>
-class Handler<std::multimap<std::string, T, Hash, Equal>>
-    : public MapHandler<std::multimap<std::string, T, Hash, Equal>>
+template <class KeyAlloc, class T, class Compare, class Alloc>
+class Handler<std::multimap<nonpublic::KeyString<KeyAlloc>, T, Compare, Alloc>>
+    : public MapHandler<std::multimap<nonpublic::KeyString<KeyAlloc>, T, Compare, Alloc>>
 {
 public:
-    explicit Handler(std::multimap<std::string, T, Hash, Equal>* value)
-        : MapHandler<std::multimap<std::string, T, Hash, Equal>>(value)
+    explicit Handler(std::multimap<nonpublic::KeyString<KeyAlloc>, T, Compare, Alloc>* value)
+        : Handler::MapHandler(value)
     {
     }
 
@@ -993,5 +1528,21 @@ public:
         str += '>';
         return str;
     }
+
+    nonpublic::TypeNameRenderer type_name_renderer() const override
+    {
+        return nonpublic::type_name_renderer_of<std::tuple<Ts...>>();
+    }
+
+    void describe_footprint(FootprintNode& node) const override
+    {
+        const std::size_t sizes[] = {0, sizeof(Handler<Ts>)...};
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            nonpublic::describe_handler(
+                node.add("element handler " + std::to_string(i), sizes[i + 1]),
+                *this->handlers[i]);
+        }
+    }
 };
 }
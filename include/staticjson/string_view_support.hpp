@@ -0,0 +1,15 @@
+#pragma once
+
+#include "primitive_types.hpp"
+
+#include <string_view>
+
+namespace staticjson
+{
+template <>
+class Handler<std::string_view> : public StringViewHandler<std::string_view>
+{
+public:
+    explicit Handler(std::string_view* v) : StringViewHandler<std::string_view>(v) {}
+};
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/writer.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace staticjson
+{
+// Destination of serialized output. The serializer buffers its output internally and hands it to
+// the sink in large chunks, so implementations need not buffer themselves.
+class IOutputSink
+{
+public:
+    IOutputSink() {}
+    IOutputSink(const IOutputSink&) = delete;
+    IOutputSink& operator=(const IOutputSink&) = delete;
+    virtual ~IOutputSink();
+
+    // Returns false to abort serialization (e.g. on an I/O error).
+    virtual bool write(const char* data, std::size_t size) = 0;
+};
+
+class StringSink : public IOutputSink
+{
+private:
+    std::string* m_str;
+
+public:
+    explicit StringSink(std::string* str) : m_str(str) {}
+
+    bool write(const char* data, std::size_t size) override
+    {
+        m_str->append(data, size);
+        return true;
+    }
+};
+
+class VectorSink : public IOutputSink
+{
+private:
+    std::vector<char>* m_vec;
+
+public:
+    explicit VectorSink(std::vector<char>* vec) : m_vec(vec) {}
+
+    bool write(const char* data, std::size_t size) override
+    {
+        m_vec->insert(m_vec->end(), data, data + size);
+        return true;
+    }
+};
+
+namespace nonpublic
+{
+    // Returns the first character in [begin, end) that must be escaped in a JSON string, i.e. a
+    // control character, '"' or '\\', or `end` if there is none. Uses the widest vector kernel
+    // supported by the running CPU.
+    const char* find_json_escape(const char* begin, const char* end);
+
+    // Longest output of `format_float`
+    const std::size_t max_float_length = 32;
+
+    // Writes the shortest decimal form of `value` that reads back as the same float, with at most
+    // `max_decimal_places` digits after the decimal point, in the notation of rapidjson. Returns
+    // the length, or 0 if `value` is not finite. Not null terminated.
+    std::size_t format_float(float value, char* buffer, int max_decimal_places);
+
+    // `GlobalConfig::getMaxDecimalPlaces()`, which cannot be named here
+    int default_max_decimal_places() noexcept;
+
+    template <class Writer>
+    inline auto write_float(Writer& w, float value, int) -> decltype(w.Float(value))
+    {
+        return w.Float(value);
+    }
+
+    template <class Writer>
+    inline bool write_float(Writer& w, float value, long)
+    {
+        return w.Double(value);
+    }
+
+    // Writes with `w.Float` if the writer has it, and as a double otherwise
+    template <class Writer>
+    inline bool write_float(Writer& w, float value)
+    {
+        return write_float(w, value, 0);
+    }
+
+    template <class OutputStream>
+    inline auto put_run(OutputStream& os, const char* str, std::size_t length, int)
+        -> decltype(os.Write(str, length), void())
+    {
+        os.Write(str, length);
+    }
+
+    template <class OutputStream>
+    inline void put_run(OutputStream& os, const char* str, std::size_t length, long)
+    {
+        for (std::size_t i = 0; i < length; ++i)
+            os.Put(str[i]);
+    }
+
+    // rapidjson writers examine strings one character at a time. This replaces the string output
+    // of `Base` (a rapidjson::Writer or PrettyWriter) with a vectorized search for the characters
+    // that need escaping, and copies the runs in between in bulk when the stream supports it.
+    template <class Base, bool pretty>
+    class FastStringWriter : public Base
+    {
+    private:
+        typedef typename Base::Ch Ch;
+
+        void prefix(rapidjson::Type type, std::true_type) { this->PrettyPrefix(type); }
+
+        void prefix(rapidjson::Type type, std::false_type) { this->Prefix(type); }
+
+        void write_escaped(const Ch* str, rapidjson::SizeType length)
+        {
+            static const char hex_digits[] = "0123456789ABCDEF";
+            auto& os = *this->os_;
+            const Ch* end = str + length;
+            os.Put('"');
+            while (true)
+            {
+                const Ch* special = find_json_escape(str, end);
+                put_run(os, str, static_cast<std::size_t>(special - str), 0);
+                if (special == end)
+                    break;
+                unsigned char c = static_cast<unsigned char>(*special);
+                os.Put('\\');
+                switch (c)
+                {
+                case '"':
+                case '\\':
+                    os.Put(static_cast<Ch>(c));
+                    break;
+                case '\b':
+                    os.Put('b');
+                    break;
+                case '\t':
+                    os.Put('t');
+                    break;
+                case '\n':
+                    os.Put('n');
+                    break;
+                case '\f':
+                    os.Put('f');
+                    break;
+                case '\r':
+                    os.Put('r');
+                    break;
+                default:
+                    os.Put('u');
+                    os.Put('0');
+                    os.Put('0');
+                    os.Put(hex_digits[c >> 4]);
+                    os.Put(hex_digits[c & 0xF]);
+                }
+                str = special + 1;
+            }
+            os.Put('"');
+        }
+
+    public:
+        template <class... Args>
+        explicit FastStringWriter(Args&&... args) : Base(std::forward<Args>(args)...)
+        {
+            this->SetMaxDecimalPlaces(default_max_decimal_places());
+        }
+
+        bool Float(float value)
+        {
+            char buffer[max_float_length];
+            std::size_t length = format_float(value, buffer, this->GetMaxDecimalPlaces());
+            if (length == 0)
+                return this->Double(value);
+            return RawValue(buffer, length, rapidjson::kNumberType);
+        }
+
+        bool String(const Ch* str, rapidjson::SizeType length, bool copy = false)
+        {
+            (void)copy;
+            prefix(rapidjson::kStringType, std::integral_constant<bool, pretty>());
+            write_escaped(str, length);
+            return this->EndValue(true);
+        }
+
+        bool Key(const Ch* str, rapidjson::SizeType length, bool copy = false)
+        {
+            return String(str, length, copy);
+        }
+
+        bool RawValue(const Ch* json, std::size_t length, rapidjson::Type type)
+        {
+            prefix(type, std::integral_constant<bool, pretty>());
+            put_run(*this->os_, json, length, 0);
+            return this->EndValue(true);
+        }
+    };
+
+    template <class OutputStream, class StackAllocator = rapidjson::CrtAllocator>
+    using CompactJsonWriter = FastStringWriter<
+        rapidjson::Writer<OutputStream, rapidjson::UTF8<>, rapidjson::UTF8<>, StackAllocator>,
+        false>;
+
+    template <class OutputStream, class StackAllocator = rapidjson::CrtAllocator>
+    using PrettyJsonWriter = FastStringWriter<
+        rapidjson::PrettyWriter<OutputStream, rapidjson::UTF8<>, rapidjson::UTF8<>, StackAllocator>,
+        true>;
+
+    // Collects the writer output in a fixed buffer and hands it to the sink in chunks, so that
+    // the sink is called once per buffer instead of once per character.
+    class SinkOutputStream
+    {
+    public:
+        typedef char Ch;
+
+    private:
+        IOutputSink* sink;
+        char* buffer;
+        char* buffer_end;
+        char* current;
+        bool failed = false;
+
+        std::size_t available() const { return static_cast<std::size_t>(buffer_end - current); }
+
+    public:
+        explicit SinkOutputStream(IOutputSink* sink, char* buffer, std::size_t buffer_size)
+            : sink(sink), buffer(buffer), buffer_end(buffer + buffer_size), current(buffer)
+        {
+        }
+
+        SinkOutputStream(const SinkOutputStream&) = delete;
+        SinkOutputStream& operator=(const SinkOutputStream&) = delete;
+
+        ~SinkOutputStream() { Flush(); }
+
+        void Put(char c)
+        {
+            if (current == buffer_end)
+                Flush();
+            *current++ = c;
+        }
+
+        void PutN(char c, std::size_t n)
+        {
+            while (n > 0)
+            {
+                if (current == buffer_end)
+                    Flush();
+                std::size_t count = std::min(n, available());
+                std::memset(current, c, count);
+                current += count;
+                n -= count;
+            }
+        }
+
+        void Write(const char* data, std::size_t n)
+        {
+            if (n > static_cast<std::size_t>(buffer_end - buffer))
+            {
+                Flush();
+                if (!failed)
+                    failed = !sink->write(data, n);
+                return;
+            }
+            if (n > available())
+                Flush();
+            std::memcpy(current, data, n);
+            current += n;
+        }
+
+        // Starts a fresh chunk when a run of `n` characters would otherwise straddle two.
+        void Reserve(std::size_t n)
+        {
+            if (n > available() && n <= static_cast<std::size_t>(buffer_end - buffer))
+                Flush();
+        }
+
+        void Flush()
+        {
+            if (current != buffer && !failed)
+                failed = !sink->write(buffer, static_cast<std::size_t>(current - buffer));
+            current = buffer;
+        }
+
+        bool good() const { return !failed; }
+    };
+
+    // Found by argument dependent lookup from within rapidjson::Writer.
+    inline void PutReserve(SinkOutputStream& os, std::size_t n) { os.Reserve(n); }
+
+    inline void PutN(SinkOutputStream& os, char c, std::size_t n) { os.PutN(c, n); }
+
+    typedef CompactJsonWriter<SinkOutputStream> CompactSinkWriter;
+    typedef PrettyJsonWriter<SinkOutputStream> PrettySinkWriter;
+}
+}
@@ -1,20 +1,39 @@
 #include <staticjson/document.hpp>
 #include <staticjson/staticjson.hpp>
 
+#include "string_escape.hpp"
+
 #include <rapidjson/error/en.h>
 #include <rapidjson/error/error.h>
 #include <rapidjson/filereadstream.h>
 #include <rapidjson/filewritestream.h>
+#include <rapidjson/internal/dtoa.h>
 #include <rapidjson/prettywriter.h>
 #include <rapidjson/reader.h>
 #include <rapidjson/writer.h>
 
+#include <algorithm>
+#include <climits>
 #include <cstdarg>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <memory>
+#include <mutex>
 #include <new>
 
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
 namespace staticjson
 {
 // Adapted from Jettison's implementation (http://jettison.codehaus.org/)
@@ -233,6 +252,10 @@ std::string error::RecursionTooDeepError::description() const
     return "Too many levels of recursion";
 }
 std::string error::TooManyLeavesError::description() const { return "Too many leaves"; }
+std::string error::MemoryBudgetExceededError::description() const
+{
+    return "Memory budget of the parse exceeded";
+}
 std::string error::CorruptedDOMError::description() const { return "JSON has invalid structure"; }
 
 std::string error::ArrayLengthMismatchError::description() const
@@ -260,9 +283,53 @@ std::string ParseStatus::short_description() const
         rapidjson::GetParseError_En(static_cast<rapidjson::ParseErrorCode>(m_code)));
 }
 
+const std::size_t ParseStatus::max_path_length;
+
+void ParseStatus::compact_errors()
+{
+    std::size_t depth = 0;
+    for (auto&& err : m_stack)
+    {
+        if (err.is_intermediate())
+            ++depth;
+    }
+    // The innermost error comes first
+    m_error_type = error::SUCCESS;
+    m_path_length = std::min(depth, max_path_length);
+    for (auto&& err : m_stack)
+    {
+        if (!err.is_intermediate())
+        {
+            if (m_error_type == error::SUCCESS)
+                m_error_type = err.type();
+            continue;
+        }
+        --depth;
+        if (depth >= max_path_length)
+            continue;
+        std::size_t index = 0;
+        if (err.type() == error::OBJECT_MEMBER)
+            index = static_cast<const error::ObjectMemberError&>(err).index();
+        else if (err.type() == error::ARRAY_ELEMENT)
+            index = static_cast<const error::ArrayElementError&>(err).index();
+        m_path[depth] = static_cast<std::uint32_t>(index);
+    }
+    ErrorStack().swap(m_stack);
+}
+
 std::string ParseStatus::description() const
 {
     std::string res = short_description();
+    if (m_code_only && m_error_type != error::SUCCESS)
+    {
+        res += stringprintf("\nError type %d at path ", m_error_type);
+        for (std::size_t i = 0; i < m_path_length; ++i)
+        {
+            res += '/';
+            res += std::to_string(m_path[i]);
+        }
+        res += '\n';
+    }
     if (m_stack)
     {
         res += "\nTraceback (last call first)\n";
@@ -277,19 +344,123 @@ std::string ParseStatus::description() const
     return res;
 }
 
+namespace
+{
+    // Error objects are small and short lived, and a failing parse makes a few of them. Each
+    // thread keeps the blocks of the errors it frees for reuse, without locking. The blocks are
+    // plain heap memory, so an error freed on another thread joins the list of that thread, or
+    // goes back to the heap when the list is full.
+    const std::size_t error_block_size = 128, max_cached_error_blocks = 64;
+
+    struct ErrorBlock
+    {
+        ErrorBlock* next;
+    };
+
+    // Trivially destructible, so that it stays usable while other thread locals are destroyed
+    struct ErrorBlockCache
+    {
+        ErrorBlock* head;
+        std::size_t count;
+        bool closed;
+    };
+
+    ErrorBlockCache& error_block_cache() noexcept
+    {
+        static thread_local ErrorBlockCache cache = {nullptr, 0, false};
+        return cache;
+    }
+
+    // Returns the cached blocks of a thread to the heap when it exits
+    struct ErrorBlockCacheCloser
+    {
+        ~ErrorBlockCacheCloser()
+        {
+            ErrorBlockCache& cache = error_block_cache();
+            cache.closed = true;
+            while (ErrorBlock* block = cache.head)
+            {
+                cache.head = block->next;
+                ::operator delete(block);
+            }
+            cache.count = 0;
+        }
+    };
+
+    // The cache of this thread, or null once the thread is exiting
+    ErrorBlockCache* open_error_block_cache() noexcept
+    {
+        ErrorBlockCache& cache = error_block_cache();
+        if (cache.closed)
+            return nullptr;
+        static thread_local ErrorBlockCacheCloser closer;
+        (void)closer;
+        return &cache;
+    }
+}
+
+void* ErrorBase::operator new(std::size_t size)
+{
+    if (size > error_block_size)
+        return ::operator new(size);
+    ErrorBlockCache* cache = open_error_block_cache();
+    if (cache && cache->head)
+    {
+        ErrorBlock* block = cache->head;
+        cache->head = block->next;
+        --cache->count;
+        return block;
+    }
+    return ::operator new(error_block_size);
+}
+
+void ErrorBase::operator delete(void* ptr, std::size_t size) noexcept
+{
+    if (!ptr)
+        return;
+    ErrorBlockCache* cache = size > error_block_size ? nullptr : open_error_block_cache();
+    if (!cache || cache->count >= max_cached_error_blocks)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+    ErrorBlock* block = static_cast<ErrorBlock*>(ptr);
+    block->next = cache->head;
+    cache->head = block;
+    ++cache->count;
+}
+
 IHandler::~IHandler() {}
 
 BaseHandler::~BaseHandler() {}
 
+IOutputSink::~IOutputSink() {}
+
 bool BaseHandler::set_out_of_range(const char* actual_type)
 {
-    the_error.reset(new error::NumberOutOfRangeError(type_name(), actual_type));
+    auto render = type_name_renderer();
+    if (render || nonpublic::CodeOnlyErrorScope::active())
+        the_error.reset(new error::NumberOutOfRangeError(render, actual_type));
+    else
+        the_error.reset(new error::NumberOutOfRangeError(type_name(), actual_type));
+    return false;
+}
+
+bool BaseHandler::charge_memory(std::size_t bytes)
+{
+    if (nonpublic::charge_memory(bytes))
+        return true;
+    the_error.reset(new error::MemoryBudgetExceededError());
     return false;
 }
 
 bool BaseHandler::set_type_mismatch(const char* actual_type)
 {
-    the_error.reset(new error::TypeMismatchError(type_name(), actual_type));
+    auto render = type_name_renderer();
+    if (render || nonpublic::CodeOnlyErrorScope::active())
+        the_error.reset(new error::TypeMismatchError(render, actual_type));
+    else
+        the_error.reset(new error::TypeMismatchError(type_name(), actual_type));
     return false;
 }
 
@@ -299,9 +470,16 @@ bool IHandler::RawNumber(const char*, SizeType, bool)
     std::terminate();
 }
 
+bool IHandler::Float(float f) { return Double(f); }
+
+bool IHandler::QuotedKey(const char* str, SizeType length, const char*, SizeType)
+{
+    return Key(str, length, true);
+}
+
 ObjectHandler::ObjectHandler()
-    : memory_pool_allocator(GlobalConfig::getInstance()->getMemoryChunkSize(),
-                            &mempool::get_crt_allocator())
+    : chunks(mempool::current_chunk_allocator())
+    , memory_pool_allocator(GlobalConfig::getInstance()->getMemoryChunkSize(), chunks)
     , internals(decltype(internals)::allocator_type(&memory_pool_allocator))
     , current_name(decltype(current_name)::allocator_type(&memory_pool_allocator))
     , leavesStack(decltype(leavesStack)::container_type::allocator_type(&memory_pool_allocator))
@@ -312,6 +490,45 @@ ObjectHandler::~ObjectHandler() {}
 
 std::string ObjectHandler::type_name() const { return "object"; }
 
+void ObjectHandler::describe_footprint(FootprintNode& node) const
+{
+    // The fields on the way to this object, whose handlers are not created again below it so
+    // that recursive types end
+    static thread_local std::vector<const nonpublic::FieldOps*> expanding;
+
+    std::size_t map_bytes = 0;
+    for (auto&& pair : internals)
+    {
+        // Each entry is a tree node of three pointers and a color, holding a pooled name
+        map_bytes += sizeof(pair) + 4 * sizeof(void*) + pair.second.quoted_name_length;
+    }
+    node.add("field map", map_bytes, internals.size());
+
+    for (auto&& pair : internals)
+    {
+        const FlaggedHandler& fh = pair.second;
+        FootprintNode& child = node.add(mempool::to_std_string(pair.first), fh.ops->handler_size);
+        if (!fh.handler
+            && std::find(expanding.begin(), expanding.end(), fh.ops) != expanding.end())
+        {
+            child.type = "(recursive)";
+            continue;
+        }
+        expanding.push_back(fh.ops);
+        try
+        {
+            nonpublic::describe_handler(child, *get_handler(fh));
+        }
+        catch (...)
+        {
+            expanding.pop_back();
+            throw;
+        }
+        expanding.pop_back();
+    }
+    node.add("unused memory pool", memory_pool_allocator.Capacity() - memory_pool_allocator.Size());
+}
+
 void ObjectHandler::postinit()
 {
     size_t max_string_size = 0;
@@ -329,8 +546,7 @@ bool ObjectHandler::precheck(const char* actual_type)
 {
     if (depth <= 0)
     {
-        the_error.reset(new error::TypeMismatchError(type_name(), actual_type));
-        return false;
+        return set_type_mismatch(actual_type);
     }
     if (current && current->handler && current->handler->is_parsed())
     {
@@ -340,7 +556,8 @@ bool ObjectHandler::precheck(const char* actual_type)
         }
         else
         {
-            the_error.reset(new error::DuplicateKeyError(mempool::to_std_string(current_name)));
+            the_error.reset(new error::DuplicateKeyError(
+                std::string(current_name.data(), nonpublic::detail_length(current_name.size()))));
             return false;
         }
     }
@@ -351,7 +568,11 @@ bool ObjectHandler::postcheck(bool success)
 {
     if (!success)
     {
-        the_error.reset(new error::ObjectMemberError(mempool::to_std_string(current_name)));
+        std::size_t index = static_cast<std::size_t>(
+            std::distance(internals.begin(), internals.find(current_name)));
+        the_error.reset(new error::ObjectMemberError(
+            std::string(current_name.data(), nonpublic::detail_length(current_name.size())),
+            index));
     }
     return success;
 }
@@ -364,7 +585,8 @@ void ObjectHandler::set_missing_required(const std::string& name)
     std::vector<std::string>& missing
         = static_cast<error::RequiredFieldMissingError*>(the_error.get())->missing_members();
 
-    missing.push_back(name);
+    if (!nonpublic::CodeOnlyErrorScope::active())
+        missing.push_back(name);
 }
 
 #define POSTCHECK(x) (!current || !(current->handler) || postcheck(x))
@@ -534,7 +756,7 @@ bool ObjectHandler::Key(const char* str, SizeType sz, bool copy)
             current = nullptr;
             if ((flags & Flags::DisallowUnknownKey))
             {
-                the_error.reset(new error::UnknownFieldError(str, sz));
+                the_error.reset(new error::UnknownFieldError(str, nonpublic::detail_length(sz)));
                 return false;
             }
         }
@@ -545,6 +767,7 @@ bool ObjectHandler::Key(const char* str, SizeType sz, bool copy)
         else
         {
             current = &it->second;
+            get_handler(*current);
         }
         return true;
     }
@@ -582,10 +805,11 @@ bool ObjectHandler::EndObject(SizeType sz)
     }
     for (auto&& pair : internals)
     {
-        if (pair.second.handler && !(pair.second.flags & Flags::Optional)
-            && !pair.second.handler->is_parsed())
+        if (!(pair.second.flags & Flags::Optional)
+            && (!pair.second.handler || !pair.second.handler->is_parsed()))
         {
-            set_missing_required(mempool::to_std_string(pair.first));
+            set_missing_required(
+                std::string(pair.first.data(), nonpublic::detail_length(pair.first.size())));
         }
     }
     if (!the_error)
@@ -608,9 +832,100 @@ void ObjectHandler::reset()
     }
 }
 
+// Escapes exactly like rapidjson::Writer does for UTF-8 output.
+static std::size_t json_escaped_length(const char* str, std::size_t length)
+{
+    std::size_t result = 0;
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        if (c == '"' || c == '\\' || c == '\b' || c == '\t' || c == '\n' || c == '\f' || c == '\r')
+            result += 2;
+        else if (c < 0x20)
+            result += 6;
+        else
+            result += 1;
+    }
+    return result;
+}
+
+static char* json_escape(const char* str, std::size_t length, char* out)
+{
+    static const char hex_digits[] = "0123456789ABCDEF";
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        unsigned char c = static_cast<unsigned char>(str[i]);
+        char escaped = 0;
+        switch (c)
+        {
+        case '"':
+            escaped = '"';
+            break;
+        case '\\':
+            escaped = '\\';
+            break;
+        case '\b':
+            escaped = 'b';
+            break;
+        case '\t':
+            escaped = 't';
+            break;
+        case '\n':
+            escaped = 'n';
+            break;
+        case '\f':
+            escaped = 'f';
+            break;
+        case '\r':
+            escaped = 'r';
+            break;
+        default:
+            if (c < 0x20)
+            {
+                *out++ = '\\';
+                *out++ = 'u';
+                *out++ = '0';
+                *out++ = '0';
+                *out++ = hex_digits[c >> 4];
+                *out++ = hex_digits[c & 0xF];
+                continue;
+            }
+            *out++ = static_cast<char>(c);
+            continue;
+        }
+        *out++ = '\\';
+        *out++ = escaped;
+    }
+    return out;
+}
+
 void ObjectHandler::add_handler(mempool::String&& name, ObjectHandler::FlaggedHandler&& fh)
 {
-    internals.emplace(std::move(name), std::move(fh));
+    auto result = internals.emplace(std::move(name), std::move(fh));
+    if (!result.second)
+        return;
+    const mempool::String& key = result.first->first;
+    FlaggedHandler& added = result.first->second;
+    std::size_t length = json_escaped_length(key.data(), key.size()) + 2;
+    char* quoted = static_cast<char*>(memory_pool_allocator.Malloc(length));
+    if (!quoted)
+        mempool::throw_bad_alloc();
+    quoted[0] = '"';
+    *json_escape(key.data(), key.size(), quoted + 1) = '"';
+    added.quoted_name = quoted;
+    added.quoted_name_length = static_cast<SizeType>(length);
+}
+
+BaseHandler* ObjectHandler::create_handler(const FlaggedHandler& fh) const
+{
+    void* storage = memory_pool_allocator.Malloc(fh.ops->handler_size);
+    if (!storage)
+        mempool::throw_bad_alloc();
+    mempool::ChunkAllocatorScope chunk_scope(chunks);
+    fh.handler.reset(fh.ops->construct(storage, fh.field));
+    if (fh.capacity_hint || (fh.flags & Flags::LearnCapacity))
+        fh.handler->set_capacity_hint(fh.capacity_hint, (fh.flags & Flags::LearnCapacity) != 0);
+    return fh.handler.get();
 }
 
 bool ObjectHandler::reap_error(ErrorStack& stack)
@@ -625,22 +940,8 @@ bool ObjectHandler::reap_error(ErrorStack& stack)
 
 bool ObjectHandler::write(IHandler* output) const
 {
-    SizeType count = 0;
-    if (!output->StartObject())
-        return false;
-
-    for (auto&& pair : internals)
-    {
-        if (!pair.second.handler || (pair.second.flags & Flags::IgnoreWrite))
-            continue;
-        if (!output->Key(
-                pair.first.data(), static_cast<staticjson::SizeType>(pair.first.size()), true))
-            return false;
-        if (!pair.second.handler->write(output))
-            return false;
-        ++count;
-    }
-    return output->EndObject(count);
+    nonpublic::IHandlerWriter w(output);
+    return write_to(w);
 }
 
 void ObjectHandler::generate_schema(Value& output, MemoryPoolAllocator& alloc) const
@@ -653,10 +954,7 @@ void ObjectHandler::generate_schema(Value& output, MemoryPoolAllocator& alloc) c
     for (auto&& pair : internals)
     {
         Value schema;
-        if (pair.second.handler)
-            pair.second.handler->generate_schema(schema, alloc);
-        else
-            std::abort();
+        get_handler(pair.second)->generate_schema(schema, alloc);
         Value key;
         key.SetString(pair.first.c_str(), static_cast<SizeType>(pair.first.size()), alloc);
         properties.AddMember(key, schema, alloc);
@@ -678,190 +976,1390 @@ void ObjectHandler::generate_schema(Value& output, MemoryPoolAllocator& alloc) c
 
 namespace nonpublic
 {
-    template <class T>
-    class IHandlerAdapter : public IHandler
+    ParsePlan* compile_parse_plan(const ObjectHandler& h, const void* base, std::size_t size)
     {
-    private:
-        T* t;
-
-    public:
-        explicit IHandlerAdapter(T* t) : t(t) {}
-
-        virtual bool Null() override { return t->Null(); }
-
-        virtual bool Bool(bool v) override { return t->Bool(v); }
-
-        virtual bool Int(int v) override { return t->Int(v); }
-
-        virtual bool Uint(unsigned v) override { return t->Uint(v); }
-
-        virtual bool Int64(std::int64_t v) override { return t->Int64(v); }
-
-        virtual bool Uint64(std::uint64_t v) override { return t->Uint64(v); }
-
-        virtual bool Double(double v) override { return t->Double(v); }
-
-        virtual bool String(const char* str, SizeType sz, bool copy) override
+        std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(base);
+        std::size_t names_size = 0;
+        for (auto&& pair : h.internals)
         {
-            return t->String(str, sz, copy);
+            const ObjectHandler::FlaggedHandler& fh = pair.second;
+            std::uintptr_t address = reinterpret_cast<std::uintptr_t>(fh.field);
+            // Learning needs a handler that lives from one parse to the next
+            if (!fh.ops || address < begin || address - begin >= size
+                || (fh.flags & Flags::LearnCapacity))
+                return nullptr;
+            names_size += pair.first.size() + fh.quoted_name_length;
         }
 
-        virtual bool StartObject() override { return t->StartObject(); }
-
-        virtual bool Key(const char* str, SizeType sz, bool copy) override
+        std::unique_ptr<ParsePlan> plan(new ParsePlan());
+        plan->flags = h.get_flags();
+        plan->names.reset(new char[names_size + 1]);
+        plan->fields.reserve(h.internals.size());
+        char* names = plan->names.get();
+        for (auto&& pair : h.internals)
         {
-            return t->Key(str, sz, copy);
+            const ObjectHandler::FlaggedHandler& fh = pair.second;
+            PlanField f;
+            f.name = names;
+            f.name_length = static_cast<SizeType>(pair.first.size());
+            names = std::copy(pair.first.begin(), pair.first.end(), names);
+            f.quoted_name = names;
+            f.quoted_name_length = fh.quoted_name_length;
+            names = std::copy(fh.quoted_name, fh.quoted_name + fh.quoted_name_length, names);
+            f.offset = reinterpret_cast<std::uintptr_t>(fh.field) - begin;
+            f.flags = fh.flags;
+            f.ops = fh.ops;
+            f.capacity_hint = fh.capacity_hint;
+            f.sub_plan = nullptr;
+            if (fh.ops->opcode == FieldOps::OP_OBJECT)
+                f.sub_plan = fh.ops->sub_plan(fh.field);
+            plan->max_handler_size = std::max(plan->max_handler_size, fh.ops->handler_size);
+            if (f.sub_plan)
+                plan->max_handler_size
+                    = std::max(plan->max_handler_size, f.sub_plan->max_handler_size);
+            plan->fields.push_back(f);
         }
+        return plan.release();
+    }
 
-        virtual bool EndObject(SizeType sz) override { return t->EndObject(sz); }
-
-        virtual bool StartArray() override { return t->StartArray(); }
-
-        virtual bool EndArray(SizeType sz) override { return t->EndArray(sz); }
-
-        virtual void prepare_for_reuse() override { std::terminate(); }
-    };
-
-    template <class InputStream>
-    static bool read_json(InputStream& is, BaseHandler* h, ParseStatus* status)
+    ParsePlan* compile_table_plan(const TableField* entries,
+                                  std::size_t count,
+                                  unsigned flags,
+                                  std::size_t (*find_in_table)(const char*, SizeType))
     {
-        rapidjson::Reader r;
-        rapidjson::ParseResult rc = r.Parse(is, *h);
-        if (status)
+        std::vector<std::size_t> sorted(count);
+        std::size_t names_size = 0;
+        for (std::size_t i = 0; i < count; ++i)
         {
-            status->set_result(rc.Code(), rc.Offset());
-            h->reap_error(status->error_stack());
+            if (entries[i].flags & Flags::LearnCapacity)
+                return nullptr;
+            sorted[i] = i;
+            names_size += entries[i].name_length
+                + json_escaped_length(entries[i].name, entries[i].name_length) + 2;
         }
-        return rc.Code() == 0;
-    }
-
-    bool parse_json_string(const char* str, BaseHandler* handler, ParseStatus* status)
-    {
-        rapidjson::StringStream is(str);
-        return read_json(is, handler, status);
-    }
-
-    bool parse_json_file(std::FILE* fp, BaseHandler* handler, ParseStatus* status)
-    {
-        if (!fp)
-            return false;
-        char buffer[1000];
-        rapidjson::FileReadStream is(fp, buffer, sizeof(buffer));
-        return read_json(is, handler, status);
+        // Sorted like `ObjectHandler::internals`, so that both write the same order
+        std::sort(sorted.begin(),
+                  sorted.end(),
+                  [entries](std::size_t a, std::size_t b) {
+                      const TableField& x = entries[a];
+                      const TableField& y = entries[b];
+                      int c = std::memcmp(x.name, y.name, std::min(x.name_length, y.name_length));
+                      return c < 0 || (c == 0 && x.name_length < y.name_length);
+                  });
+
+        std::unique_ptr<ParsePlan> plan(new ParsePlan());
+        plan->flags = flags;
+        plan->find_in_table = find_in_table;
+        plan->table_order.resize(count);
+        plan->names.reset(new char[names_size + 1]);
+        plan->fields.reserve(count);
+        char* names = plan->names.get();
+        for (std::size_t i : sorted)
+        {
+            const TableField& entry = entries[i];
+            plan->table_order[i] = plan->fields.size();
+            PlanField f;
+            f.name = names;
+            f.name_length = entry.name_length;
+            names = std::copy(entry.name, entry.name + entry.name_length, names);
+            f.quoted_name = names;
+            *names++ = '"';
+            names = json_escape(entry.name, entry.name_length, names);
+            *names++ = '"';
+            f.quoted_name_length = static_cast<SizeType>(names - f.quoted_name);
+            f.offset = entry.offset;
+            f.flags = entry.flags;
+            f.ops = entry.ops;
+            f.capacity_hint = 0;
+            f.sub_plan = nullptr;
+            if (entry.ops->opcode == FieldOps::OP_OBJECT)
+                f.sub_plan = entry.ops->sub_plan(entry.field);
+            plan->max_handler_size = std::max(plan->max_handler_size, entry.ops->handler_size);
+            if (f.sub_plan)
+                plan->max_handler_size
+                    = std::max(plan->max_handler_size, f.sub_plan->max_handler_size);
+            plan->fields.push_back(f);
+        }
+        return plan.release();
     }
 
-    struct StringOutputStream : private NonMobile
-    {
-        typedef char Ch;
-
-        std::string* str;
-
-        void Put(char c) { str->push_back(c); }
-
-        void Flush() {}
-    };
-
-    std::string serialize_json_string(const BaseHandler* handler)
-    {
-        std::string result;
-        StringOutputStream os;
-        os.str = &result;
-        rapidjson::Writer<StringOutputStream> writer(os);
-        IHandlerAdapter<decltype(writer)> adapter(&writer);
-        handler->write(&adapter);
-        return result;
-    }
+    void ParsePlanDeleter::operator()(ParsePlan* plan) const noexcept { delete plan; }
 
-    bool serialize_json_file(std::FILE* fp, const BaseHandler* handler)
-    {
-        if (!fp)
-            return false;
-        char buffer[1000];
-        rapidjson::FileWriteStream os(fp, buffer, sizeof(buffer));
-        rapidjson::Writer<rapidjson::FileWriteStream> writer(os);
-        IHandlerAdapter<decltype(writer)> adapter(&writer);
-        return handler->write(&adapter);
-    }
+    // Ordered like the `mempool::String` keys of `ObjectHandler::internals`
+    const std::size_t ParsePlan::no_field;
 
-    std::string serialize_pretty_json_string(const BaseHandler* handler)
+    void sort_table_keys(TableKey* keys, std::size_t count)
     {
-        std::string result;
-        StringOutputStream os;
-        os.str = &result;
-        rapidjson::PrettyWriter<StringOutputStream> writer(os);
-        IHandlerAdapter<decltype(writer)> adapter(&writer);
-        handler->write(&adapter);
-        result.push_back('\n');
-        return result;
+        std::sort(keys, keys + count, [](const TableKey& a, const TableKey& b) {
+            return a.key < b.key
+                || (a.key == b.key && std::memcmp(a.name, b.name, a.name_length) < 0);
+        });
     }
 
-    bool serialize_pretty_json_file(std::FILE* fp, const BaseHandler* handler)
+    std::size_t
+    find_table_key(const TableKey* keys, std::size_t count, const char* name, SizeType length)
     {
-        if (!fp)
-            return false;
-        char buffer[1000];
-        rapidjson::FileWriteStream os(fp, buffer, sizeof(buffer));
-        rapidjson::PrettyWriter<rapidjson::FileWriteStream> writer(os);
-        IHandlerAdapter<decltype(writer)> adapter(&writer);
-        bool res = handler->write(&adapter);
-        if (res)
+        std::uint64_t key = table_key(name, length);
+        std::size_t low = 0, high = count;
+        while (low < high)
         {
-            putc('\n', fp);
+            std::size_t mid = low + (high - low) / 2;
+            if (keys[mid].key < key)
+                low = mid + 1;
+            else
+                high = mid;
         }
-        return res;
-    }
-
-    bool write_value(const Value& v, BaseHandler* out, ParseStatus* status)
-    {
-        if (!v.Accept(*static_cast<IHandler*>(out)))
+        for (; low < count && keys[low].key == key; ++low)
         {
-            if (status)
-            {
-                status->set_result(rapidjson::kParseErrorTermination, 0);
-                out->reap_error(status->error_stack());
-            }
-            return false;
+            if (length <= 1 || std::memcmp(keys[low].name + 1, name + 1, length - 1) == 0)
+                return keys[low].index;
         }
-        return true;
+        return ParsePlan::no_field;
     }
 
-    bool
-    read_value(Value* v, MemoryPoolAllocator* alloc, const BaseHandler* input, ParseStatus* status)
+    const PlanField* ParsePlan::find(const char* name, SizeType length) const
     {
-        JSONHandler handler(v, alloc);
-        if (!input->write(&handler))
+        if (find_in_table)
         {
-            if (status)
+            std::size_t index = find_in_table(name, length);
+            return index == no_field ? nullptr : &fields[table_order[index]];
+        }
+        std::size_t low = 0, high = fields.size();
+        while (low < high)
+        {
+            std::size_t mid = low + (high - low) / 2;
+            const PlanField& f = fields[mid];
+            int c = std::memcmp(f.name, name, std::min(f.name_length, length));
+            if (c == 0)
             {
-                status->set_result(rapidjson::kParseErrorTermination, 0);
-                handler.reap_error(status->error_stack());
+                if (f.name_length == length)
+                    return &f;
+                c = f.name_length < length ? -1 : 1;
             }
-            return false;
+            if (c < 0)
+                low = mid + 1;
+            else
+                high = mid;
         }
-        return true;
+        return nullptr;
     }
 }
 
-JSONHandler::JSONHandler(Value* v, MemoryPoolAllocator* a) : m_stack(), m_value(v), m_alloc(a)
+PlanHandlerBase::~PlanHandlerBase() { deactivate(); }
+
+bool PlanHandlerBase::use_fallback()
 {
-    m_stack.reserve(25);
+    if (fallback)
+        return true;
+    if (!frames.empty())
+        return false;
+    plan = get_plan();
+    // The limits are counted by `ObjectHandler`, which the plan does not build
+    if (plan && !GlobalConfig::getInstance()->isMaxDepthSet()
+        && !GlobalConfig::getInstance()->isMaxLeavesSet())
+        return false;
+    mempool::ChunkAllocatorScope chunk_scope(chunks);
+    fallback = make_fallback();
+    return true;
 }
 
-bool JSONHandler::set_corrupted_dom()
+bool PlanHandlerBase::forward_fallback(bool success)
 {
-    the_error.reset(new error::CorruptedDOMError());
-    return false;
+    this->parsed = fallback->is_parsed();
+    return success;
 }
 
-std::string JSONHandler::type_name() const { return "JSON"; }
-
-bool JSONHandler::stack_push()
+bool PlanHandlerBase::precheck(const char* actual_type, const nonpublic::PlanField** field)
 {
-    m_stack.emplace_back();
+    if (frames.empty())
+    {
+        return set_type_mismatch(actual_type);
+    }
+    Frame& top = frames.back();
+    *field = top.current;
+    if (!top.current)
+        return true;
+    char& field_parsed = parsed_fields[top.parsed_offset + top.plan->index_of(top.current)];
+    if (field_parsed)
+    {
+        if (top.plan->flags & Flags::AllowDuplicateKey)
+        {
+            field_parsed = 0;
+        }
+        else
+        {
+            the_error.reset(new error::DuplicateKeyError(std::string(
+                top.current->name, nonpublic::detail_length(top.current->name_length))));
+            return false;
+        }
+    }
     return true;
 }
 
-void JSONHandler::stack_pop()
+bool PlanHandlerBase::postcheck(bool success)
+{
+    const Frame& top = frames.back();
+    const nonpublic::PlanField* field = top.current;
+    if (!success)
+    {
+        the_error.reset(new error::ObjectMemberError(
+            std::string(field->name, nonpublic::detail_length(field->name_length)),
+            top.plan->index_of(field)));
+        return false;
+    }
+    if (active->is_parsed())
+    {
+        deactivate();
+        return set_parsed(field);
+    }
+    return true;
+}
+
+bool PlanHandlerBase::activate(const nonpublic::PlanField* field)
+{
+    if (!active_storage)
+    {
+        std::size_t size = plan->max_handler_size;
+        active_storage.reset(
+            new std::max_align_t[(size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)]);
+    }
+    mempool::ChunkAllocatorScope chunk_scope(chunks);
+    active = field->ops->construct(active_storage.get(), address_of(field));
+    if (field->capacity_hint)
+        active->set_capacity_hint(field->capacity_hint, false);
+    return true;
+}
+
+void PlanHandlerBase::deactivate()
+{
+    if (active)
+    {
+        active->~BaseHandler();
+        active = nullptr;
+    }
+}
+
+bool PlanHandlerBase::set_parsed(const nonpublic::PlanField* field)
+{
+    const Frame& top = frames.back();
+    parsed_fields[top.parsed_offset + top.plan->index_of(field)] = 1;
+    return true;
+}
+
+void PlanHandlerBase::push_frame(const nonpublic::ParsePlan* p, char* base)
+{
+    Frame f;
+    f.plan = p;
+    f.base = base;
+    f.current = nullptr;
+    f.parsed_offset = parsed_fields.size();
+    f.skip_depth = 0;
+    parsed_fields.resize(parsed_fields.size() + p->fields.size(), 0);
+    frames.push_back(f);
+}
+
+void PlanHandlerBase::set_missing_required(const std::string& name)
+{
+    if (!the_error || the_error->type() != error::MISSING_REQUIRED)
+        the_error.reset(new error::RequiredFieldMissingError());
+
+    if (!nonpublic::CodeOnlyErrorScope::active())
+        static_cast<error::RequiredFieldMissingError*>(the_error.get())
+            ->missing_members()
+            .push_back(name);
+}
+
+void PlanHandlerBase::reset()
+{
+    deactivate();
+    frames.clear();
+    parsed_fields.clear();
+    if (fallback)
+        fallback->prepare_for_reuse();
+}
+
+#define PLAN_FORWARD(call)                                                                         \
+    if (use_fallback())                                                                            \
+        return forward_fallback(fallback->call);                                                   \
+    if (active)                                                                                    \
+        return postcheck(active->call);
+
+#define PLAN_ACTIVATE(call) (!field || (activate(field) && postcheck(active->call)))
+
+bool PlanHandlerBase::Null()
+{
+    PLAN_FORWARD(Null())
+    const nonpublic::PlanField* field;
+    if (!precheck("null", &field))
+        return false;
+    return PLAN_ACTIVATE(Null());
+}
+
+bool PlanHandlerBase::Bool(bool b)
+{
+    PLAN_FORWARD(Bool(b))
+    const nonpublic::PlanField* field;
+    if (!precheck("bool", &field))
+        return false;
+    if (field && field->ops->opcode == nonpublic::FieldOps::OP_BOOL)
+    {
+        *reinterpret_cast<bool*>(address_of(field)) = b;
+        return set_parsed(field);
+    }
+    return PLAN_ACTIVATE(Bool(b));
+}
+
+bool PlanHandlerBase::Int(int i)
+{
+    PLAN_FORWARD(Int(i))
+    const nonpublic::PlanField* field;
+    if (!precheck("int", &field))
+        return false;
+    if (field)
+    {
+        char* address = address_of(field);
+        switch (field->ops->opcode)
+        {
+        case nonpublic::FieldOps::OP_INT:
+            *reinterpret_cast<int*>(address) = i;
+            return set_parsed(field);
+        case nonpublic::FieldOps::OP_UINT:
+            if (i < 0)
+                break;
+            *reinterpret_cast<unsigned*>(address) = static_cast<unsigned>(i);
+            return set_parsed(field);
+        case nonpublic::FieldOps::OP_INT64:
+            *reinterpret_cast<std::int64_t*>(address) = i;
+            return set_parsed(field);
+        case nonpublic::FieldOps::OP_UINT64:
+            if (i < 0)
+                break;
+            *reinterpret_cast<std::uint64_t*>(address) = static_cast<std::uint64_t>(i);
+            return set_parsed(field);
+        case nonpublic::FieldOps::OP_DOUBLE:
+            *reinterpret_cast<double*>(address) = i;
+            return set_parsed(field);
+        default:
+            break;
+        }
+    }
+    return PLAN_ACTIVATE(Int(i));
+}
+
+bool PlanHandlerBase::Uint(unsigned i)
+{
+    PLAN_FORWARD(Uint(i))
+    const nonpublic::PlanField* field;
+    if (!precheck("unsigned", &field))
+        return false;
+    if (field)
+    {
+        char* address = address_of(field);
+        switch (field->ops->opcode)
+        {
+        case nonpublic::FieldOps::OP_INT:
+            if (i > static_cast<unsigned>(INT_MAX))
+                break;
+            *reinterpret_cast<int*>(address) = static_cast<int>(i);
+            return set_parsed(field);
+        case nonpublic::FieldOps::OP_UINT:
+            *reinterpret_cast<unsigned*>(address) = i;
+            return set_parsed(field);
+        case nonpublic::FieldOps::OP_INT64:
+            *reinterpret_cast<std::int64_t*>(address) = i;
+            return set_parsed(field);
+        case nonpublic::FieldOps::OP_UINT64:
+            *reinterpret_cast<std::uint64_t*>(address) = i;
+            return set_parsed(field);
+        case nonpublic::FieldOps::OP_DOUBLE:
+            *reinterpret_cast<double*>(address) = i;
+            return set_parsed(field);
+        default:
+            break;
+        }
+    }
+    return PLAN_ACTIVATE(Uint(i));
+}
+
+bool PlanHandlerBase::Int64(std::int64_t i)
+{
+    PLAN_FORWARD(Int64(i))
+    const nonpublic::PlanField* field;
+    if (!precheck("std::int64_t", &field))
+        return false;
+    if (field)
+    {
+        char* address = address_of(field);
+        switch (field->ops->opcode)
+        {
+        case nonpublic::FieldOps::OP_INT64:
+            *reinterpret_cast<std::int64_t*>(address) = i;
+            return set_parsed(field);
+        case nonpublic::FieldOps::OP_UINT64:
+            if (i < 0)
+                break;
+            *reinterpret_cast<std::uint64_t*>(address) = static_cast<std::uint64_t>(i);
+            return set_parsed(field);
+        default:
+            break;
+        }
+    }
+    return PLAN_ACTIVATE(Int64(i));
+}
+
+bool PlanHandlerBase::Uint64(std::uint64_t i)
+{
+    PLAN_FORWARD(Uint64(i))
+    const nonpublic::PlanField* field;
+    if (!precheck("std::uint64_t", &field))
+        return false;
+    if (field)
+    {
+        char* address = address_of(field);
+        switch (field->ops->opcode)
+        {
+        case nonpublic::FieldOps::OP_INT64:
+            if (i > static_cast<std::uint64_t>(INT64_MAX))
+                break;
+            *reinterpret_cast<std::int64_t*>(address) = static_cast<std::int64_t>(i);
+            return set_parsed(field);
+        case nonpublic::FieldOps::OP_UINT64:
+            *reinterpret_cast<std::uint64_t*>(address) = i;
+            return set_parsed(field);
+        default:
+            break;
+        }
+    }
+    return PLAN_ACTIVATE(Uint64(i));
+}
+
+bool PlanHandlerBase::Double(double d)
+{
+    PLAN_FORWARD(Double(d))
+    const nonpublic::PlanField* field;
+    if (!precheck("double", &field))
+        return false;
+    if (field && field->ops->opcode == nonpublic::FieldOps::OP_DOUBLE)
+    {
+        *reinterpret_cast<double*>(address_of(field)) = d;
+        return set_parsed(field);
+    }
+    return PLAN_ACTIVATE(Double(d));
+}
+
+bool PlanHandlerBase::String(const char* str, SizeType length, bool copy)
+{
+    PLAN_FORWARD(String(str, length, copy))
+    const nonpublic::PlanField* field;
+    if (!precheck("string", &field))
+        return false;
+    if (field && field->ops->opcode == nonpublic::FieldOps::OP_STRING)
+    {
+        std::string* s = reinterpret_cast<std::string*>(address_of(field));
+        std::size_t capacity = s->capacity();
+        s->assign(str, length);
+        if (s->capacity() > capacity && !charge_memory(s->capacity() + 1))
+            return false;
+        return set_parsed(field);
+    }
+    return PLAN_ACTIVATE(String(str, length, copy));
+}
+
+bool PlanHandlerBase::StartObject()
+{
+    PLAN_FORWARD(StartObject())
+    if (frames.empty())
+    {
+        push_frame(plan, m_base);
+        return true;
+    }
+    const nonpublic::PlanField* field;
+    if (!precheck("object", &field))
+        return false;
+    if (!field)
+    {
+        ++frames.back().skip_depth;
+        return true;
+    }
+    if (field->sub_plan)
+    {
+        push_frame(field->sub_plan, address_of(field));
+        return true;
+    }
+    return PLAN_ACTIVATE(StartObject());
+}
+
+bool PlanHandlerBase::Key(const char* str, SizeType length, bool copy)
+{
+    PLAN_FORWARD(Key(str, length, copy))
+    if (frames.empty())
+    {
+        the_error.reset(new error::CorruptedDOMError());
+        return false;
+    }
+    Frame& top = frames.back();
+    if (top.skip_depth > 0)
+        return true;
+    const nonpublic::PlanField* field = top.plan->find(str, length);
+    if (!field)
+    {
+        top.current = nullptr;
+        if (top.plan->flags & Flags::DisallowUnknownKey)
+        {
+            the_error.reset(
+                new error::UnknownFieldError(str, nonpublic::detail_length(length)));
+            return false;
+        }
+    }
+    else if (field->flags & Flags::IgnoreRead)
+    {
+        top.current = nullptr;
+    }
+    else
+    {
+        top.current = field;
+    }
+    return true;
+}
+
+bool PlanHandlerBase::EndObject(SizeType length)
+{
+    PLAN_FORWARD(EndObject(length))
+    if (frames.empty())
+    {
+        the_error.reset(new error::CorruptedDOMError());
+        return false;
+    }
+    Frame& top = frames.back();
+    if (top.skip_depth > 0)
+    {
+        --top.skip_depth;
+        return true;
+    }
+    for (std::size_t i = 0; i < top.plan->fields.size(); ++i)
+    {
+        const nonpublic::PlanField& f = top.plan->fields[i];
+        if (!(f.flags & Flags::Optional) && !parsed_fields[top.parsed_offset + i])
+            set_missing_required(std::string(f.name, nonpublic::detail_length(f.name_length)));
+    }
+    if (the_error)
+        return false;
+    parsed_fields.resize(top.parsed_offset);
+    frames.pop_back();
+    if (frames.empty())
+    {
+        this->parsed = true;
+        return true;
+    }
+    return set_parsed(frames.back().current);
+}
+
+bool PlanHandlerBase::StartArray()
+{
+    PLAN_FORWARD(StartArray())
+    const nonpublic::PlanField* field;
+    if (!precheck("array", &field))
+        return false;
+    return PLAN_ACTIVATE(StartArray());
+}
+
+bool PlanHandlerBase::EndArray(SizeType length)
+{
+    PLAN_FORWARD(EndArray(length))
+    const nonpublic::PlanField* field;
+    if (!precheck("array", &field))
+        return false;
+    return PLAN_ACTIVATE(EndArray(length));
+}
+
+#undef PLAN_FORWARD
+#undef PLAN_ACTIVATE
+
+bool PlanHandlerBase::has_error() const
+{
+    return fallback ? fallback->has_error() : BaseHandler::has_error();
+}
+
+bool PlanHandlerBase::reap_error(ErrorStack& stack)
+{
+    if (fallback)
+        return fallback->reap_error(stack);
+    if (!the_error)
+        return false;
+    for (std::size_t i = 0; i + 1 < frames.size(); ++i)
+    {
+        const nonpublic::PlanField* f = frames[i].current;
+        stack.push(new error::ObjectMemberError(
+            std::string(f->name, nonpublic::detail_length(f->name_length)),
+            frames[i].plan->index_of(f)));
+    }
+    stack.push(the_error.release());
+    if (active)
+        active->reap_error(stack);
+    return true;
+}
+
+bool PlanHandlerBase::write(IHandler* output) const
+{
+    nonpublic::IHandlerWriter w(output);
+    return write_to(w);
+}
+
+void PlanHandlerBase::generate_schema(Value& output, MemoryPoolAllocator& alloc) const
+{
+    make_fallback()->generate_schema(output, alloc);
+}
+
+void PlanHandlerBase::describe_footprint(FootprintNode& node) const
+{
+    const nonpublic::ParsePlan* p = plan ? plan : get_plan();
+    if (p)
+    {
+        node.add("parse plan (shared by the type)",
+                 p->fields.capacity() * sizeof(nonpublic::PlanField),
+                 p->fields.size());
+    }
+    if (frames.capacity())
+        node.add("frames", frames.capacity() * sizeof(Frame), frames.size());
+    if (parsed_fields.capacity())
+        node.add("parsed flags", parsed_fields.capacity(), parsed_fields.size());
+    if (active_storage && p)
+        node.add("field handler storage", p->max_handler_size);
+    if (fallback)
+        nonpublic::describe_handler(node.add("fallback", sizeof(ObjectHandler)), *fallback);
+}
+
+FootprintNode& FootprintNode::add(std::string name, std::size_t bytes, std::size_t objects)
+{
+    children.emplace_back();
+    FootprintNode& child = children.back();
+    child.name = std::move(name);
+    child.bytes = bytes;
+    child.objects = objects;
+    return child;
+}
+
+FootprintNode& FootprintNode::split(std::string name, std::size_t bytes)
+{
+    this->bytes -= std::min(this->bytes, bytes);
+    return add(std::move(name), bytes);
+}
+
+std::size_t FootprintNode::total_bytes() const
+{
+    std::size_t result = bytes;
+    for (const FootprintNode& child : children)
+        result += child.total_bytes();
+    return result;
+}
+
+std::size_t FootprintNode::total_objects() const
+{
+    std::size_t result = objects;
+    for (const FootprintNode& child : children)
+        result += child.total_objects();
+    return result;
+}
+
+static void describe_footprint_node(const FootprintNode& node, int indent, std::string& out)
+{
+    out.append(static_cast<std::size_t>(indent) * 2, ' ');
+    out += node.name;
+    if (!node.type.empty())
+    {
+        out += " <";
+        out += node.type;
+        out += '>';
+    }
+    out += stringprintf(": bytes=%zu objects=%zu (in all: bytes=%zu objects=%zu)\n",
+                        node.bytes,
+                        node.objects,
+                        node.total_bytes(),
+                        node.total_objects());
+    for (const FootprintNode& child : node.children)
+        describe_footprint_node(child, indent + 1, out);
+}
+
+std::string HandlerFootprint::description() const
+{
+    std::string result = stringprintf("Constructed in %lld ns\n",
+                                      static_cast<long long>(construction_time.count()));
+    describe_footprint_node(root, 0, result);
+    return result;
+}
+
+namespace nonpublic
+{
+    void describe_handler(FootprintNode& node, const BaseHandler& h)
+    {
+        node.type = h.type_name();
+        h.describe_footprint(node);
+    }
+
+    void reap_errors(BaseHandler* handler, ParseStatus* status)
+    {
+        handler->reap_error(status->error_stack());
+        // Stopped by the reader handler rather than by a handler of the tree
+        const MemoryAccountScope* account = active_memory_account();
+        if (account && account->over_budget() && status->error_stack().empty())
+            status->error_stack().push(new error::MemoryBudgetExceededError());
+        if (status->is_code_only())
+            status->compact_errors();
+    }
+
+    // The virtual counterpart of `StaticReaderHandler`, which stops the parse once the memory
+    // budget is exceeded
+    class BudgetedReaderHandler
+    {
+    private:
+        IHandler* h;
+        const MemoryAccountScope* account;
+
+        bool within_budget() const { return !account || !account->over_budget(); }
+
+    public:
+        explicit BudgetedReaderHandler(IHandler* h) : h(h), account(active_memory_account()) {}
+
+        bool Null() { return h->Null() && within_budget(); }
+        bool Bool(bool b) { return h->Bool(b) && within_budget(); }
+        bool Int(int i) { return h->Int(i) && within_budget(); }
+        bool Uint(unsigned i) { return h->Uint(i) && within_budget(); }
+        bool Int64(std::int64_t i) { return h->Int64(i) && within_budget(); }
+        bool Uint64(std::uint64_t i) { return h->Uint64(i) && within_budget(); }
+        bool Double(double d) { return h->Double(d) && within_budget(); }
+        bool RawNumber(const char* str, SizeType length, bool copy)
+        {
+            return h->RawNumber(str, length, copy) && within_budget();
+        }
+        bool String(const char* str, SizeType length, bool copy)
+        {
+            return h->String(str, length, copy) && within_budget();
+        }
+        bool StartObject() { return h->StartObject() && within_budget(); }
+        bool Key(const char* str, SizeType length, bool copy)
+        {
+            return h->Key(str, length, copy) && within_budget();
+        }
+        bool EndObject(SizeType length) { return h->EndObject(length) && within_budget(); }
+        bool StartArray() { return h->StartArray() && within_budget(); }
+        bool EndArray(SizeType length) { return h->EndArray(length) && within_budget(); }
+    };
+
+    template <class InputStream>
+    static bool read_json(InputStream& is, BaseHandler* h, ParseStatus* status)
+    {
+        MemoryAccountScope memory_account(status);
+        CodeOnlyErrorScope code_only(status && status->is_code_only());
+        BudgetedReaderHandler forwarder(h);
+        rapidjson::Reader r;
+        rapidjson::ParseResult rc = r.Parse(is, forwarder);
+        if (status)
+        {
+            status->set_result(rc.Code(), rc.Offset());
+            reap_errors(h, status);
+        }
+        return rc.Code() == 0;
+    }
+
+    bool parse_json_string(const char* str, BaseHandler* handler, ParseStatus* status)
+    {
+        rapidjson::StringStream is(str);
+        return read_json(is, handler, status);
+    }
+
+    bool parse_json_file(std::FILE* fp, BaseHandler* handler, ParseStatus* status)
+    {
+        if (!fp)
+            return false;
+        char buffer[1000];
+        rapidjson::FileReadStream is(fp, buffer, sizeof(buffer));
+        return read_json(is, handler, status);
+    }
+
+    // Grisu2 of rapidjson, with the rounding boundaries of the float instead of those of the
+    // double it converts to. The digits always read back as the same float. They are the
+    // shortest ones except when a shorter number lies exactly on a boundary, which Grisu2
+    // excludes; that only happens for floats above 2^24.
+    std::size_t format_float(float value, char* buffer, int max_decimal_places)
+    {
+        using rapidjson::internal::DiyFp;
+
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        std::uint32_t biased_exponent = (bits >> 23) & 0xFF;
+        std::uint32_t fraction = bits & 0x7FFFFF;
+        if (biased_exponent == 0xFF)
+            return 0;
+
+        char* p = buffer;
+        if (bits >> 31)
+            *p++ = '-';
+        if (biased_exponent == 0 && fraction == 0)
+        {
+            std::memcpy(p, "0.0", 3);
+            return static_cast<std::size_t>(p + 3 - buffer);
+        }
+
+        std::uint64_t significand = fraction;
+        int exponent = -149;
+        if (biased_exponent != 0)
+        {
+            significand |= 0x800000;
+            exponent = static_cast<int>(biased_exponent) - 150;
+        }
+
+        DiyFp plus = DiyFp((significand << 1) + 1, exponent - 1).Normalize();
+        // The next float down is closer at the bottom of a binade
+        DiyFp minus = (fraction == 0 && biased_exponent > 1)
+            ? DiyFp((significand << 2) - 1, exponent - 2)
+            : DiyFp((significand << 1) - 1, exponent - 1);
+        minus.f <<= minus.e - plus.e;
+        minus.e = plus.e;
+
+        int k;
+        const DiyFp c_mk = rapidjson::internal::GetCachedPower(plus.e, &k);
+        const DiyFp w = DiyFp(significand, exponent).Normalize() * c_mk;
+        DiyFp wp = plus * c_mk;
+        DiyFp wm = minus * c_mk;
+        wm.f++;
+        wp.f--;
+        int length;
+        rapidjson::internal::DigitGen(w, wp, wp.f - wm.f, p, &length, &k);
+        char* end = rapidjson::internal::Prettify(p, length, k, max_decimal_places);
+        return static_cast<std::size_t>(end - buffer);
+    }
+
+    int default_max_decimal_places() noexcept
+    {
+        return GlobalConfig::getInstance()->getMaxDecimalPlaces();
+    }
+
+    static bool serialize_buffered(IOutputSink* sink,
+                                   char* buffer,
+                                   std::size_t buffer_size,
+                                   const BaseHandler* handler,
+                                   bool pretty)
+    {
+        SinkOutputStream os(sink, buffer, buffer_size);
+        bool res;
+        if (pretty)
+        {
+            PrettyJsonWriter<SinkOutputStream> writer(os);
+            IHandlerAdapter<decltype(writer)> adapter(&writer);
+            res = handler->write(&adapter);
+            os.Put('\n');
+        }
+        else
+        {
+            CompactJsonWriter<SinkOutputStream> writer(os);
+            IHandlerAdapter<decltype(writer)> adapter(&writer);
+            res = handler->write(&adapter);
+        }
+        os.Flush();
+        return res && os.good();
+    }
+
+    bool serialize_json_sink(IOutputSink* sink, const BaseHandler* handler)
+    {
+        char buffer[4096];
+        return serialize_buffered(sink, buffer, sizeof(buffer), handler, false);
+    }
+
+    bool serialize_pretty_json_sink(IOutputSink* sink, const BaseHandler* handler)
+    {
+        char buffer[4096];
+        return serialize_buffered(sink, buffer, sizeof(buffer), handler, true);
+    }
+
+    // Discards the output and only counts it, so the size is exactly what the writer would emit.
+    struct CountingOutputStream : private NonMobile
+    {
+        typedef char Ch;
+
+        std::size_t count = 0;
+
+        void Put(char) { ++count; }
+
+        void Write(const char*, std::size_t n) { count += n; }
+
+        void Flush() {}
+    };
+
+    inline void PutN(CountingOutputStream& os, char, std::size_t n) { os.count += n; }
+
+    std::size_t serialized_json_size(const BaseHandler* handler)
+    {
+        CountingOutputStream os;
+        CompactJsonWriter<CountingOutputStream> writer(os);
+        IHandlerAdapter<decltype(writer)> adapter(&writer);
+        handler->write(&adapter);
+        return os.count;
+    }
+
+    std::size_t serialized_pretty_json_size(const BaseHandler* handler)
+    {
+        CountingOutputStream os;
+        PrettyJsonWriter<CountingOutputStream> writer(os);
+        IHandlerAdapter<decltype(writer)> adapter(&writer);
+        handler->write(&adapter);
+        return os.count + 1;    // The trailing newline
+    }
+
+    // Serves the writer's nesting stack from an inline buffer so that writing shallow documents
+    // does not touch the heap; deeper nesting spills over to malloc. Every block is preceded by a
+    // header recording where it lives, because rapidjson frees through the static `Free`.
+    class InlineStackAllocator : private NonMobile
+    {
+    private:
+        static const std::size_t header_size = alignof(std::max_align_t);
+        static const std::size_t inline_capacity = 1024;
+        static const char inline_tag = 0, heap_tag = 1;
+
+        alignas(std::max_align_t) char storage[header_size + inline_capacity];
+
+        void* inline_block() { return storage + header_size; }
+
+    public:
+        static const bool kNeedFree = true;
+
+        InlineStackAllocator() { storage[0] = inline_tag; }
+
+        void* Malloc(std::size_t size) { return Realloc(nullptr, 0, size); }
+
+        void* Realloc(void* p, std::size_t old_size, std::size_t new_size)
+        {
+            if (new_size <= inline_capacity && (!p || p == inline_block()))
+                return inline_block();
+            char* block = static_cast<char*>(std::malloc(header_size + new_size));
+            if (!block)
+                return nullptr;
+            block[0] = heap_tag;
+            void* result = block + header_size;
+            if (p)
+            {
+                std::memcpy(result, p, std::min(old_size, new_size));
+                Free(p);
+            }
+            return result;
+        }
+
+        static void Free(void* p)
+        {
+            if (!p)
+                return;
+            char* block = static_cast<char*>(p) - header_size;
+            if (block[0] == heap_tag)
+                std::free(block);
+        }
+    };
+
+    // Writes into a fixed caller-owned buffer and counts what did not fit.
+    struct FixedBufferOutputStream : private NonMobile
+    {
+        typedef char Ch;
+
+        char* current;
+        char* end;
+        std::size_t overflow = 0;
+
+        FixedBufferOutputStream(char* buffer, std::size_t capacity)
+            : current(buffer), end(buffer + capacity)
+        {
+        }
+
+        void Put(char c)
+        {
+            if (current != end)
+                *current++ = c;
+            else
+                ++overflow;
+        }
+
+        void Write(const char* data, std::size_t n)
+        {
+            std::size_t count = std::min(n, static_cast<std::size_t>(end - current));
+            std::memcpy(current, data, count);
+            current += count;
+            overflow += n - count;
+        }
+
+        void Flush() {}
+    };
+
+    template <template <class, class> class Writer>
+    static std::size_t
+    serialize_into_buffer(char* buffer, std::size_t capacity, const BaseHandler* handler)
+    {
+        FixedBufferOutputStream os(buffer, capacity);
+        InlineStackAllocator stack_allocator;
+        Writer<FixedBufferOutputStream, InlineStackAllocator> writer(os, &stack_allocator);
+        IHandlerAdapter<decltype(writer)> adapter(&writer);
+        if (!handler->write(&adapter))
+            return 0;
+        return static_cast<std::size_t>(os.current - buffer) + os.overflow;
+    }
+
+    std::size_t
+    serialize_json_buffer(char* buffer, std::size_t capacity, const BaseHandler* handler)
+    {
+        return serialize_into_buffer<CompactJsonWriter>(buffer, capacity, handler);
+    }
+
+    std::size_t
+    serialize_pretty_json_buffer(char* buffer, std::size_t capacity, const BaseHandler* handler)
+    {
+        std::size_t size
+            = serialize_into_buffer<PrettyJsonWriter>(buffer, capacity, handler);
+        if (size == 0)
+            return 0;
+        if (size < capacity)
+            buffer[size] = '\n';
+        return size + 1;
+    }
+
+    std::string serialize_json_string(const BaseHandler* handler)
+    {
+        std::string result;
+        StringSink sink(&result);
+        serialize_json_sink(&sink, handler);
+        return result;
+    }
+
+    bool serialize_json_file(std::FILE* fp, const BaseHandler* handler)
+    {
+        if (!fp)
+            return false;
+        char buffer[1000];
+        rapidjson::FileWriteStream os(fp, buffer, sizeof(buffer));
+        CompactJsonWriter<rapidjson::FileWriteStream> writer(os);
+        IHandlerAdapter<decltype(writer)> adapter(&writer);
+        return handler->write(&adapter);
+    }
+
+    std::string serialize_pretty_json_string(const BaseHandler* handler)
+    {
+        std::string result;
+        StringSink sink(&result);
+        serialize_pretty_json_sink(&sink, handler);
+        return result;
+    }
+
+    bool serialize_pretty_json_file(std::FILE* fp, const BaseHandler* handler)
+    {
+        if (!fp)
+            return false;
+        char buffer[1000];
+        rapidjson::FileWriteStream os(fp, buffer, sizeof(buffer));
+        PrettyJsonWriter<rapidjson::FileWriteStream> writer(os);
+        IHandlerAdapter<decltype(writer)> adapter(&writer);
+        bool res = handler->write(&adapter);
+        if (res)
+        {
+            putc('\n', fp);
+        }
+        return res;
+    }
+
+#ifndef _WIN32
+    class FdSink : public IOutputSink
+    {
+    private:
+        int fd;
+
+    public:
+        explicit FdSink(int fd) : fd(fd) {}
+
+        bool write(const char* data, std::size_t size) override
+        {
+            while (size > 0)
+            {
+                ssize_t written = ::write(fd, data, size);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+                data += written;
+                size -= static_cast<std::size_t>(written);
+            }
+            return true;
+        }
+    };
+
+    // Writes straight into a shared mapping of the output file, growing the file and the mapping
+    // geometrically. The file is trimmed to the written size at the end.
+    // Allocates the blocks of a range of `fd`, extending the file if needed. Returns an error
+    // number like `posix_fallocate`.
+    static int reserve_file_space(int fd, std::size_t offset, std::size_t length)
+    {
+#ifdef __APPLE__
+        (void)fd;
+        (void)offset;
+        (void)length;
+        return EOPNOTSUPP;
+#else
+        return ::posix_fallocate(fd, static_cast<off_t>(offset), static_cast<off_t>(length));
+#endif
+    }
+
+    class MmapOutputStream : private NonMobile
+    {
+    public:
+        typedef char Ch;
+
+    private:
+        int fd;
+        std::size_t start;
+        std::size_t grow_size;
+        // Size of the file before the output, which is kept if the output is shorter
+        std::size_t original_size = 0;
+        char* map = nullptr;
+        std::size_t map_size = 0;
+        // Set when the space for the mapping cannot be reserved, after which the output goes
+        // through `write(2)` from here, starting at file offset `written`
+        std::unique_ptr<char[]> buffer;
+        std::size_t written = 0;
+        char* current;
+        char* end;
+        bool failed = false;
+        // Absorbs the remaining output after a failure.
+        char scratch[64];
+
+        void fail()
+        {
+            failed = true;
+            current = scratch;
+            end = scratch + sizeof(scratch);
+        }
+
+        void switch_to_write(std::size_t offset)
+        {
+            if (::lseek(fd, static_cast<off_t>(offset), SEEK_SET) < 0)
+            {
+                fail();
+                return;
+            }
+            buffer.reset(new char[grow_size]);
+            written = offset;
+            current = buffer.get();
+            end = current + grow_size;
+        }
+
+        void flush_buffer()
+        {
+            const char* data = buffer.get();
+            while (data < current)
+            {
+                ssize_t n = ::write(fd, data, static_cast<std::size_t>(current - data));
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                {
+                    fail();
+                    return;
+                }
+                data += n;
+                written += static_cast<std::size_t>(n);
+            }
+            current = buffer.get();
+        }
+
+        void grow()
+        {
+            if (failed)
+            {
+                current = scratch;
+                return;
+            }
+            if (buffer)
+            {
+                flush_buffer();
+                return;
+            }
+            std::size_t offset = map ? static_cast<std::size_t>(current - map) : start;
+            std::size_t new_size = std::max(offset + grow_size, map_size * 2);
+            if (map)
+                ::munmap(map, map_size);
+            map = nullptr;
+            // A store to a page without blocks behind it raises SIGBUS when the disk is full, so
+            // the blocks are allocated before they are mapped
+            int rc = reserve_file_space(fd, offset, new_size - offset);
+            if (rc == ENOSPC || rc == EOPNOTSUPP)
+            {
+                switch_to_write(offset);
+                return;
+            }
+            void* p = MAP_FAILED;
+            if (rc == 0)
+                p = ::mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                fail();
+                return;
+            }
+            map = static_cast<char*>(p);
+            map_size = new_size;
+            current = map + offset;
+            end = map + map_size;
+        }
+
+    public:
+        MmapOutputStream(int fd, std::size_t grow_size)
+            : fd(fd), start(0), grow_size(std::max<std::size_t>(grow_size, 4096))
+        {
+            current = end = scratch;
+            off_t pos = ::lseek(fd, 0, SEEK_CUR);
+            struct stat st;
+            if (pos < 0 || ::fstat(fd, &st) != 0)
+                fail();
+            else
+            {
+                start = static_cast<std::size_t>(pos);
+                original_size = static_cast<std::size_t>(st.st_size);
+                grow();
+            }
+        }
+
+        ~MmapOutputStream()
+        {
+            if (map)
+                ::munmap(map, map_size);
+        }
+
+        void Put(char c)
+        {
+            if (current == end)
+                grow();
+            *current++ = c;
+        }
+
+        void Write(const char* data, std::size_t n)
+        {
+            while (n > 0)
+            {
+                if (current == end)
+                    grow();
+                std::size_t count = std::min(n, static_cast<std::size_t>(end - current));
+                std::memcpy(current, data, count);
+                current += count;
+                data += count;
+                n -= count;
+            }
+        }
+
+        void Flush() {}
+
+        // Only the space added by `grow` is truncated away, so that like with `write(2)` the
+        // bytes of the file past the output are kept
+        bool finish()
+        {
+            if (buffer && !failed)
+                flush_buffer();
+            if (failed)
+            {
+                // Best effort removal of the space added for the output
+                int rc = ::ftruncate(fd, static_cast<off_t>(std::max(start, original_size)));
+                (void)rc;
+                return false;
+            }
+            std::size_t size = buffer ? written : static_cast<std::size_t>(current - map);
+            if (map)
+                ::munmap(map, map_size);
+            map = nullptr;
+            return ::ftruncate(fd, static_cast<off_t>(std::max(size, original_size))) == 0
+                && ::lseek(fd, static_cast<off_t>(size), SEEK_SET) >= 0;
+        }
+    };
+
+    static bool
+    serialize_mmap(int fd, const BaseHandler* handler, const FdOutputOptions& options)
+    {
+        MmapOutputStream os(fd, options.buffer_size);
+        bool res;
+        if (options.pretty)
+        {
+            PrettyJsonWriter<MmapOutputStream> writer(os);
+            IHandlerAdapter<decltype(writer)> adapter(&writer);
+            res = handler->write(&adapter);
+            os.Put('\n');
+        }
+        else
+        {
+            CompactJsonWriter<MmapOutputStream> writer(os);
+            IHandlerAdapter<decltype(writer)> adapter(&writer);
+            res = handler->write(&adapter);
+        }
+        return os.finish() && res;
+    }
+
+    bool serialize_json_fd(int fd, const BaseHandler* handler, const FdOutputOptions& options)
+    {
+        if (fd < 0)
+            return false;
+        if (options.memory_mapped)
+            return serialize_mmap(fd, handler, options);
+        std::size_t buffer_size = std::max<std::size_t>(options.buffer_size, 64);
+        std::unique_ptr<char[]> buffer(new char[buffer_size]);
+        FdSink sink(fd);
+        return serialize_buffered(&sink, buffer.get(), buffer_size, handler, options.pretty);
+    }
+#endif
+
+    bool write_value(const Value& v, BaseHandler* out, ParseStatus* status)
+    {
+        CodeOnlyErrorScope code_only(status && status->is_code_only());
+        BudgetedReaderHandler forwarder(out);
+        if (!v.Accept(forwarder))
+        {
+            if (status)
+            {
+                status->set_result(rapidjson::kParseErrorTermination, 0);
+                reap_errors(out, status);
+            }
+            return false;
+        }
+        return true;
+    }
+
+    bool
+    read_value(Value* v, MemoryPoolAllocator* alloc, const BaseHandler* input, ParseStatus* status)
+    {
+        CodeOnlyErrorScope code_only(status && status->is_code_only());
+        JSONHandler handler(v, alloc);
+        if (!input->write(&handler))
+        {
+            if (status)
+            {
+                status->set_result(rapidjson::kParseErrorTermination, 0);
+                reap_errors(&handler, status);
+            }
+            return false;
+        }
+        return true;
+    }
+}
+
+JSONHandler::JSONHandler(Value* v, MemoryPoolAllocator* a) : m_stack(), m_value(v), m_alloc(a)
+{
+    m_stack.reserve(25);
+}
+
+bool JSONHandler::set_corrupted_dom()
+{
+    the_error.reset(new error::CorruptedDOMError());
+    return false;
+}
+
+std::string JSONHandler::type_name() const { return "JSON"; }
+
+bool JSONHandler::stack_push()
+{
+    m_stack.emplace_back();
+    return true;
+}
+
+void JSONHandler::stack_pop()
 {
     if (!m_stack.empty())
         m_stack.pop_back();
@@ -1028,10 +2526,652 @@ namespace mempool
 #endif
     }
 
-    rapidjson::CrtAllocator& get_crt_allocator() noexcept
+    static Arena*& current_arena() noexcept
+    {
+        static thread_local Arena* arena = nullptr;
+        return arena;
+    }
+
+    // Every chunk of an accounted allocator is preceded by its size, which is released from the
+    // memory account when the chunk is freed
+    static const std::size_t chunk_header_size = alignof(std::max_align_t) > sizeof(std::size_t)
+        ? alignof(std::max_align_t)
+        : sizeof(std::size_t);
+
+    void* ChunkAllocator::Malloc(std::size_t size)
+    {
+        if (!size)
+            return nullptr;
+        if (!accounted)
+            return arena ? arena->allocate(size) : std::malloc(size);
+        nonpublic::charge_memory(size);
+        std::size_t total = size + chunk_header_size;
+        char* p = static_cast<char*>(arena ? arena->allocate(total) : std::malloc(total));
+        if (!p)
+            return nullptr;
+        *reinterpret_cast<std::size_t*>(p) = size;
+        return p + chunk_header_size;
+    }
+
+    void* ChunkAllocator::Realloc(void* ptr, std::size_t old_size, std::size_t new_size)
+    {
+        if (!ptr)
+            return Malloc(new_size);
+        if (!new_size)
+        {
+            Free(ptr);
+            return nullptr;
+        }
+        if (!arena && !accounted)
+            return std::realloc(ptr, new_size);
+        if (!arena)
+        {
+            char* p = static_cast<char*>(ptr) - chunk_header_size;
+            std::size_t size = *reinterpret_cast<std::size_t*>(p);
+            p = static_cast<char*>(std::realloc(p, new_size + chunk_header_size));
+            if (!p)
+                return nullptr;
+            nonpublic::release_memory(size);
+            nonpublic::charge_memory(new_size);
+            *reinterpret_cast<std::size_t*>(p) = new_size;
+            return p + chunk_header_size;
+        }
+        void* result = Malloc(new_size);
+        if (result)
+            std::memcpy(result, ptr, std::min(old_size, new_size));
+        Free(ptr);
+        return result;
+    }
+
+    void ChunkAllocator::Free(void* ptr) noexcept
+    {
+        if (!ptr)
+            return;
+        if (accounted)
+        {
+            ptr = static_cast<char*>(ptr) - chunk_header_size;
+            nonpublic::release_memory(*static_cast<std::size_t*>(ptr));
+        }
+        if (arena)
+            arena->deallocate(ptr);
+        else
+            std::free(ptr);
+    }
+
+    static ChunkAllocator*& scoped_chunk_allocator() noexcept
+    {
+        static thread_local ChunkAllocator* chunks = nullptr;
+        return chunks;
+    }
+
+    ChunkAllocator* current_chunk_allocator() noexcept
+    {
+        static ChunkAllocator heap;
+        static ChunkAllocator accounted_heap(nullptr, true);
+        if (ChunkAllocator* scoped = scoped_chunk_allocator())
+            return scoped;
+        bool accounted = nonpublic::active_memory_account() != nullptr;
+        if (Arena* arena = current_arena())
+            return arena->chunk_allocator(accounted);
+        return accounted ? &accounted_heap : &heap;
+    }
+
+    ChunkAllocatorScope::ChunkAllocatorScope(ChunkAllocator* chunks) noexcept
+        : previous(scoped_chunk_allocator())
+    {
+        scoped_chunk_allocator() = chunks;
+    }
+
+    ChunkAllocatorScope::~ChunkAllocatorScope() { scoped_chunk_allocator() = previous; }
+}
+
+// Every allocation is preceded by the index of its size class, or `direct_allocation`
+static const std::size_t arena_header_size = alignof(std::max_align_t) > sizeof(std::size_t)
+    ? alignof(std::max_align_t)
+    : sizeof(std::size_t);
+static const std::size_t arena_min_class_size = 64;
+static const std::size_t direct_allocation = static_cast<std::size_t>(-1);
+
+Arena::Arena(const ArenaOptions& options)
+    : options(options), chunks(this), accounted_chunks(this, true)
+{
+    this->options.block_size = std::max<std::size_t>(this->options.block_size, 4096);
+    std::size_t classes = 1;
+    while ((arena_min_class_size << classes) <= this->options.block_size / 4)
+        ++classes;
+    free_lists.assign(classes, nullptr);
+}
+
+Arena::~Arena()
+{
+    for (const Block& b : blocks)
+    {
+#ifndef _WIN32
+        if (b.mapped)
+        {
+            munmap(b.data, b.size);
+            continue;
+        }
+#endif
+        std::free(b.data);
+    }
+}
+
+void Arena::add_block()
+{
+    Block b;
+    b.size = options.block_size;
+    b.mapped = false;
+#ifdef __linux__
+    if (options.huge_pages)
+    {
+        const std::size_t huge_page_size = 2 * 1024 * 1024;
+        b.size = (b.size + huge_page_size - 1) / huge_page_size * huge_page_size;
+        void* p = mmap(nullptr,
+                       b.size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                       -1,
+                       0);
+        if (p == MAP_FAILED)
+        {
+            // No huge pages reserved, so ask for transparent ones instead
+            p = mmap(nullptr, b.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED)
+                madvise(p, b.size, MADV_HUGEPAGE);
+        }
+        if (p == MAP_FAILED)
+            mempool::throw_bad_alloc();
+        b.data = static_cast<char*>(p);
+        b.mapped = true;
+        blocks.push_back(b);
+        return;
+    }
+#endif
+    b.data = static_cast<char*>(std::malloc(b.size));
+    if (!b.data)
+        mempool::throw_bad_alloc();
+    blocks.push_back(b);
+}
+
+void* Arena::allocate(std::size_t size)
+{
+    std::size_t total = size + arena_header_size;
+    char* p;
+    std::size_t size_class = 0;
+    if (total > options.block_size / 4)
+    {
+        p = static_cast<char*>(std::malloc(total));
+        if (!p)
+            return nullptr;
+        size_class = direct_allocation;
+    }
+    else
+    {
+        while ((arena_min_class_size << size_class) < total)
+            ++size_class;
+        if (free_lists[size_class])
+        {
+            p = static_cast<char*>(free_lists[size_class]);
+            free_lists[size_class] = *reinterpret_cast<void**>(p);
+        }
+        else
+        {
+            std::size_t class_size = arena_min_class_size << size_class;
+            while (current_block < blocks.size()
+                   && current_offset + class_size > blocks[current_block].size)
+            {
+                ++current_block;
+                current_offset = 0;
+            }
+            if (current_block == blocks.size())
+                add_block();
+            p = blocks[current_block].data + current_offset;
+            current_offset += class_size;
+        }
+    }
+    *reinterpret_cast<std::size_t*>(p) = size_class;
+    ++outstanding;
+    return p + arena_header_size;
+}
+
+void Arena::deallocate(void* ptr) noexcept
+{
+    if (!ptr)
+        return;
+    char* p = static_cast<char*>(ptr) - arena_header_size;
+    std::size_t size_class = *reinterpret_cast<std::size_t*>(p);
+    --outstanding;
+    if (size_class == direct_allocation)
+    {
+        std::free(p);
+        return;
+    }
+    *reinterpret_cast<void**>(p) = free_lists[size_class];
+    free_lists[size_class] = p;
+}
+
+void Arena::reset() noexcept
+{
+    if (outstanding)
+        return;
+    std::fill(free_lists.begin(), free_lists.end(), nullptr);
+    current_block = 0;
+    current_offset = 0;
+}
+
+std::size_t Arena::capacity() const noexcept
+{
+    std::size_t result = 0;
+    for (const Block& b : blocks)
+        result += b.size;
+    return result;
+}
+
+ArenaScope::ArenaScope(Arena* arena) noexcept : previous(mempool::current_arena())
+{
+    mempool::current_arena() = arena;
+}
+
+ArenaScope::~ArenaScope() { mempool::current_arena() = previous; }
+
+Arena* ArenaScope::current() noexcept { return mempool::current_arena(); }
+
+StringArena::~StringArena()
+{
+    for (const Block& b : blocks)
+        std::free(b.data);
+}
+
+const char* StringArena::store(const char* str, std::size_t length)
+{
+    std::size_t size = length + 1;
+    while (current_block < blocks.size() && current_offset + size > blocks[current_block].size)
+    {
+        ++current_block;
+        current_offset = 0;
+    }
+    if (current_block == blocks.size())
+    {
+        Block b;
+        b.size = std::max(block_size, size);
+        b.data = static_cast<char*>(std::malloc(b.size));
+        if (!b.data)
+            mempool::throw_bad_alloc();
+        blocks.push_back(b);
+        current_offset = 0;
+    }
+    char* result = blocks[current_block].data + current_offset;
+    std::memcpy(result, str, length);
+    result[length] = '\0';
+    current_offset += size;
+    return result;
+}
+
+void StringArena::clear() noexcept
+{
+    current_block = 0;
+    current_offset = 0;
+}
+
+std::size_t StringArena::capacity() const noexcept
+{
+    std::size_t result = 0;
+    for (const Block& b : blocks)
+        result += b.size;
+    return result;
+}
+
+static bool& reparse_in_place() noexcept
+{
+    static thread_local bool active = false;
+    return active;
+}
+
+ReparseScope::ReparseScope() noexcept : previous(reparse_in_place()) { reparse_in_place() = true; }
+
+ReparseScope::~ReparseScope() { reparse_in_place() = previous; }
+
+bool ReparseScope::active() noexcept { return reparse_in_place(); }
+
+static bool& code_only_errors() noexcept
+{
+    static thread_local bool active = false;
+    return active;
+}
+
+nonpublic::CodeOnlyErrorScope::CodeOnlyErrorScope(bool enable) noexcept
+    : previous(code_only_errors())
+{
+    code_only_errors() = previous || enable;
+}
+
+nonpublic::CodeOnlyErrorScope::~CodeOnlyErrorScope() { code_only_errors() = previous; }
+
+bool nonpublic::CodeOnlyErrorScope::active() noexcept { return code_only_errors(); }
+
+static StringArena*& current_string_arena() noexcept
+{
+    static thread_local StringArena* arena = nullptr;
+    return arena;
+}
+
+StringArenaScope::StringArenaScope(StringArena* arena) noexcept : previous(current_string_arena())
+{
+    current_string_arena() = arena;
+}
+
+StringArenaScope::~StringArenaScope() { current_string_arena() = previous; }
+
+StringArena* StringArenaScope::current() noexcept { return current_string_arena(); }
+
+namespace nonpublic
+{
+    std::size_t hash_string(const char* str, std::size_t length) noexcept
+    {
+        // FNV-1a
+        std::uint64_t h = 14695981039346656037ull;
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            h ^= static_cast<unsigned char>(str[i]);
+            h *= 1099511628211ull;
+        }
+        return static_cast<std::size_t>(h ^ (h >> 32));
+    }
+
+    // Open addressing with linear probing, kept at most half full
+    static std::size_t address_slot(const void* address, std::size_t mask) noexcept
+    {
+        std::uint64_t h = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(address))
+            * 0x9E3779B97F4A7C15ull;
+        return static_cast<std::size_t>(h ^ (h >> 32)) & mask;
+    }
+
+    void AddressSet::grow()
+    {
+        std::vector<const void*> old(std::max<std::size_t>(16, slots.size() * 2), nullptr);
+        old.swap(slots);
+        count = 0;
+        for (const void* address : old)
+            if (address)
+                insert(address);
+    }
+
+    bool AddressSet::insert(const void* address)
+    {
+        if ((count + 1) * 2 > slots.size())
+            grow();
+        std::size_t mask = slots.size() - 1;
+        for (std::size_t i = address_slot(address, mask);; i = (i + 1) & mask)
+        {
+            if (!slots[i])
+            {
+                slots[i] = address;
+                ++count;
+                return true;
+            }
+            if (slots[i] == address)
+                return false;
+        }
+    }
+
+    bool AddressSet::contains(const void* address) const noexcept
+    {
+        if (slots.empty())
+            return false;
+        std::size_t mask = slots.size() - 1;
+        for (std::size_t i = address_slot(address, mask); slots[i]; i = (i + 1) & mask)
+        {
+            if (slots[i] == address)
+                return true;
+        }
+        return false;
+    }
+
+    void AddressSet::clear() noexcept
+    {
+        std::fill(slots.begin(), slots.end(), nullptr);
+        count = 0;
+    }
+}
+
+InternedString::InternedString(const char* str, std::size_t length)
+    : entry(InternTable::current()->intern(str, length).entry)
+{
+}
+
+void InternedString::assign(const char* str, std::size_t length)
+{
+    entry = InternTable::current()->intern(str, length).entry;
+}
+
+void LruEvictionPolicy::inserted(const std::string* str)
+{
+    order.push_front(str);
+    positions[str] = order.begin();
+}
+
+void LruEvictionPolicy::used(const std::string* str)
+{
+    auto it = positions.find(str);
+    if (it != positions.end())
+        order.splice(order.begin(), order, it->second);
+}
+
+void LruEvictionPolicy::erased(const std::string* str)
+{
+    auto it = positions.find(str);
+    if (it == positions.end())
+        return;
+    order.erase(it->second);
+    positions.erase(it);
+}
+
+const std::string* LruEvictionPolicy::victim() { return order.empty() ? nullptr : order.back(); }
+
+InternTable::InternTable(const InternTableOptions& options) : options(options)
+{
+    std::size_t n = 1;
+    while (n < options.shards)
+        n *= 2;
+    max_entries_per_shard = std::max<std::size_t>(options.max_entries / n, 1);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        shards.emplace_back(new Shard());
+        if (options.make_policy)
+            shards.back()->policy = options.make_policy();
+    }
+}
+
+InternTable::~InternTable() {}
+
+InternedString InternTable::intern(const char* str, std::size_t length)
+{
+    InternedString result;
+    std::size_t hash = nonpublic::hash_string(str, length);
+    Shard& shard = *shards[hash & (shards.size() - 1)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if (length <= options.max_length)
+    {
+        auto it = shard.entries.find(Key{str, length, hash});
+        if (it != shard.entries.end())
+        {
+            ++shard.stats.hits;
+            if (shard.policy)
+                shard.policy->used(&it->second->str);
+            result.entry = it->second;
+            return result;
+        }
+        ++shard.stats.misses;
+    }
+
+    std::shared_ptr<nonpublic::InternEntry> entry = std::make_shared<nonpublic::InternEntry>();
+    entry->str.assign(str, length);
+    entry->hash = hash;
+    result.entry = entry;
+
+    if (length > options.max_length)
+    {
+        ++shard.stats.rejected;
+        return result;
+    }
+    if (shard.entries.size() >= max_entries_per_shard)
+    {
+        const std::string* victim = shard.policy ? shard.policy->victim() : nullptr;
+        auto it = victim ? shard.entries.find(Key{victim->data(),
+                                                  victim->size(),
+                                                  nonpublic::hash_string(victim->data(),
+                                                                         victim->size())})
+                         : shard.entries.end();
+        if (it == shard.entries.end())
+        {
+            ++shard.stats.rejected;
+            return result;
+        }
+        shard.policy->erased(victim);
+        shard.stats.bytes -= victim->size();
+        ++shard.stats.evictions;
+        shard.entries.erase(it);
+    }
+    shard.entries.emplace(Key{entry->str.data(), length, hash}, entry);
+    shard.stats.bytes += length;
+    if (shard.policy)
+        shard.policy->inserted(&entry->str);
+    return result;
+}
+
+InternStats InternTable::stats() const
+{
+    InternStats result;
+    for (const std::unique_ptr<Shard>& shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        result.entries += shard->entries.size();
+        result.bytes += shard->stats.bytes;
+        result.hits += shard->stats.hits;
+        result.misses += shard->stats.misses;
+        result.evictions += shard->stats.evictions;
+        result.rejected += shard->stats.rejected;
+    }
+    return result;
+}
+
+void InternTable::clear()
+{
+    for (const std::unique_ptr<Shard>& shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        if (shard->policy)
+        {
+            for (const auto& pair : shard->entries)
+                shard->policy->erased(&pair.second->str);
+        }
+        shard->entries.clear();
+        shard->stats.bytes = 0;
+    }
+}
+
+static InternTable*& current_intern_table() noexcept
+{
+    static thread_local InternTable* table = nullptr;
+    return table;
+}
+
+InternTable* InternTable::current() noexcept
+{
+    InternTable* table = current_intern_table();
+    return table ? table : &global();
+}
+
+InternTable& InternTable::global()
+{
+    static InternTable table;
+    return table;
+}
+
+InternTableScope::InternTableScope(InternTable* table) noexcept : previous(current_intern_table())
+{
+    current_intern_table() = table;
+}
+
+InternTableScope::~InternTableScope() { current_intern_table() = previous; }
+
+namespace nonpublic
+{
+    const char* reference_string(const char* str, SizeType length, bool copy)
+    {
+        if (!copy)
+            return str;
+        StringArena* arena = current_string_arena();
+        return arena ? arena->store(str, length) : nullptr;
+    }
+
+    RootArenaScope::RootArenaScope() : arena(nullptr)
+    {
+        if (mempool::current_arena() || !GlobalConfig::getInstance()->isRootArenaEnabled())
+            return;
+        static thread_local std::unique_ptr<Arena> thread_arena;
+        if (!thread_arena)
+            thread_arena.reset(new Arena(GlobalConfig::getInstance()->getArenaOptions()));
+        arena = thread_arena.get();
+        mempool::current_arena() = arena;
+    }
+
+    RootArenaScope::~RootArenaScope()
+    {
+        if (!arena)
+            return;
+        mempool::current_arena() = nullptr;
+        arena->reset();
+    }
+
+    static MemoryAccountScope*& current_memory_account() noexcept
+    {
+        static thread_local MemoryAccountScope* account = nullptr;
+        return account;
+    }
+
+    MemoryAccountScope::MemoryAccountScope(ParseStatus* status) noexcept
+        : usage(status ? &status->memory_usage() : nullptr)
+        , budget(status ? status->memory_budget() : 0)
+        , previous(current_memory_account())
+    {
+        // Without a status, memory is counted against the enclosing scope if any
+        if (!usage)
+            return;
+        *usage = MemoryUsage();
+        current_memory_account() = this;
+    }
+
+    MemoryAccountScope::~MemoryAccountScope()
+    {
+        if (usage)
+            current_memory_account() = previous;
+    }
+
+    const MemoryAccountScope* active_memory_account() noexcept { return current_memory_account(); }
+
+    bool charge_memory(std::size_t bytes) noexcept
+    {
+        MemoryAccountScope* account = current_memory_account();
+        if (!account)
+            return true;
+        MemoryUsage& usage = *account->usage;
+        usage.bytes += bytes;
+        ++usage.allocations;
+        account->held += bytes;
+        usage.peak = std::max(usage.peak, account->held);
+        if (account->budget && account->held > account->budget)
+            account->exceeded = true;
+        return !account->exceeded;
+    }
+
+    void release_memory(std::size_t bytes) noexcept
     {
-        static rapidjson::CrtAllocator a;
-        return a;
+        MemoryAccountScope* account = current_memory_account();
+        if (account)
+            account->held -= std::min(account->held, bytes);
     }
 }
 }
@@ -0,0 +1,117 @@
+#include "string_escape.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#define STATICJSON_ESCAPE_SSE2 1
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define STATICJSON_ESCAPE_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace staticjson
+{
+namespace nonpublic
+{
+    static inline bool needs_escape(char c)
+    {
+        unsigned char u = static_cast<unsigned char>(c);
+        return u < 0x20 || u == '"' || u == '\\';
+    }
+
+    const char* find_json_escape_scalar(const char* begin, const char* end)
+    {
+        while (begin != end && !needs_escape(*begin))
+            ++begin;
+        return begin;
+    }
+
+#ifdef STATICJSON_ESCAPE_SSE2
+    static inline unsigned count_trailing_zeros(unsigned bits)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return static_cast<unsigned>(index);
+#else
+        return static_cast<unsigned>(__builtin_ctz(bits));
+#endif
+    }
+
+    static const char* find_json_escape_sse2(const char* p, const char* end)
+    {
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control_max = _mm_set1_epi8(0x1F);
+        for (; end - p >= 16; p += 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            // A byte is a control character iff min(byte, 0x1F) == byte as unsigned numbers
+            __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(chunk, control_max), chunk);
+            __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                           _mm_cmpeq_epi8(chunk, backslash));
+            unsigned bits
+                = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(control, special)));
+            if (bits)
+                return p + count_trailing_zeros(bits);
+        }
+        return find_json_escape_scalar(p, end);
+    }
+
+    FindJsonEscapeFunction get_find_json_escape_sse2() { return &find_json_escape_sse2; }
+#else
+    FindJsonEscapeFunction get_find_json_escape_sse2() { return nullptr; }
+#endif
+
+#ifdef STATICJSON_ESCAPE_AVX2
+    __attribute__((target("avx2"))) static const char* find_json_escape_avx2(const char* p,
+                                                                           const char* end)
+    {
+        const __m256i quote = _mm256_set1_epi8('"');
+        const __m256i backslash = _mm256_set1_epi8('\\');
+        const __m256i control_max = _mm256_set1_epi8(0x1F);
+        for (; end - p >= 32; p += 32)
+        {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, control_max), chunk);
+            __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote),
+                                              _mm256_cmpeq_epi8(chunk, backslash));
+            unsigned bits
+                = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_or_si256(control, special)));
+            if (bits)
+                return p + count_trailing_zeros(bits);
+        }
+        return find_json_escape_sse2(p, end);
+    }
+
+    FindJsonEscapeFunction get_find_json_escape_avx2()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return &find_json_escape_avx2;
+        return nullptr;
+    }
+#else
+    FindJsonEscapeFunction get_find_json_escape_avx2() { return nullptr; }
+#endif
+
+    static FindJsonEscapeFunction select_find_json_escape()
+    {
+        if (FindJsonEscapeFunction f = get_find_json_escape_avx2())
+            return f;
+        if (FindJsonEscapeFunction f = get_find_json_escape_sse2())
+            return f;
+        return &find_json_escape_scalar;
+    }
+
+    const char* find_json_escape(const char* begin, const char* end)
+    {
+        static const FindJsonEscapeFunction kernel = select_find_json_escape();
+        return kernel(begin, end);
+    }
+}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <staticjson/writer.hpp>
+
+#include <cstddef>
+
+namespace staticjson
+{
+namespace nonpublic
+{
+    typedef const char* (*FindJsonEscapeFunction)(const char* begin, const char* end);
+
+    // The individual kernels behind `find_json_escape`, for testing and benchmarking. The
+    // vectorized variants return null when the compiler or the running CPU does not support them.
+    const char* find_json_escape_scalar(const char* begin, const char* end);
+    FindJsonEscapeFunction get_find_json_escape_sse2();
+    FindJsonEscapeFunction get_find_json_escape_avx2();
+}
+}
@@ -15,6 +15,19 @@ struct MyObject
     }
 };
 
+// Only constructible because child handlers are created when their key is first seen
+struct TreeNode
+{
+    int value = 0;
+    std::vector<TreeNode> children;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("value", &value);
+        h->add_property("children", &children, Flags::Optional);
+    }
+};
+
 TEST_CASE("Basic test")
 {
     MyObject obj;
@@ -51,4 +64,316 @@ TEST_CASE("Serial")
     obj.i = 999;
     REQUIRE(to_pretty_json_string(obj).size() > 0);
     REQUIRE(to_json_string(std::vector<int>{1, 2, 3, 4, 5, 6}) == "[1,2,3,4,5,6]");
-}
\ No newline at end of file
+}
+
+TEST_CASE("Static and virtual parse paths agree")
+{
+    const char* inputs[] = {
+        "[{\"i\": 1}, {\"i\": 2}]",
+        "[{\"i\": 1}, {\"i\": 2, \"j\": 3}]",
+        "[{\"i\": 1}, null]",
+        "[[1]]",
+        "[{\"i\": 1},",
+    };
+    for (const char* input : inputs)
+    {
+        std::vector<std::unique_ptr<MyObject>> a, b;
+        ParseStatus status_a, status_b;
+        bool success_a = from_json_string(input, &a, &status_a);
+        Handler<std::vector<std::unique_ptr<MyObject>>> h(&b);
+        bool success_b = nonpublic::parse_json_string(input, &h, &status_b);
+        CAPTURE(input);
+        REQUIRE(success_a == success_b);
+        REQUIRE(status_a.description() == status_b.description());
+        REQUIRE(a.size() == b.size());
+        if (success_a)
+            REQUIRE(to_json_string(a) == to_json_string(b));
+    }
+}
+
+TEST_CASE("Recursive types")
+{
+    TreeNode root;
+    const char* input = "{\"value\":1,\"children\":[{\"value\":2,\"children\":[{\"value\":3}]},"
+                        "{\"value\":4}]}";
+    REQUIRE(from_json_string(input, &root, nullptr));
+    REQUIRE(root.children.size() == 2);
+    REQUIRE(root.children[0].children[0].value == 3);
+    REQUIRE(to_json_string(root)
+            == "{\"children\":[{\"children\":[{\"children\":[],\"value\":3}],\"value\":2},"
+               "{\"children\":[],\"value\":4}],\"value\":1}");
+
+    ParseStatus status;
+    REQUIRE(!from_json_string("{\"children\":[{}]}", &root, &status));
+    REQUIRE(status.begin()->type() == error::MISSING_REQUIRED);
+}
+
+#if __has_include(<memory_resource>)
+#include <cstdio>
+#include <memory_resource>
+
+TEST_CASE("Containers with polymorphic allocators")
+{
+    typedef std::pmr::unordered_map<std::pmr::string, std::pmr::vector<std::pmr::string>> Groups;
+
+    std::pmr::monotonic_buffer_resource buffer;
+    Groups groups(&buffer);
+    const char* input = "{\"a key that is long enough to allocate\":"
+                        "[\"a value too long for small strings\",\"v\"]}";
+
+    // Elements are made with the allocator of their container, so nothing goes through the
+    // default resource
+    std::pmr::memory_resource* previous
+        = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+    bool success = from_json_string(input, &groups, nullptr);
+    std::pmr::set_default_resource(previous);
+    REQUIRE(success);
+
+    REQUIRE(groups.size() == 1);
+    CHECK(groups.begin()->first.get_allocator().resource() == &buffer);
+    CHECK(groups.begin()->second.get_allocator().resource() == &buffer);
+    CHECK(groups.begin()->second[0].get_allocator().resource() == &buffer);
+    CHECK(to_json_string(groups)
+          == "{\"a key that is long enough to allocate\":"
+             "[\"a value too long for small strings\",\"v\"]}");
+
+    std::pmr::list<std::pmr::deque<int>> lists(&buffer);
+    REQUIRE(from_json_string("[[1, 2], [], [3]]", &lists, nullptr));
+    CHECK(lists.back().get_allocator().resource() == &buffer);
+    CHECK(to_json_string(lists) == "[[1,2],[],[3]]");
+}
+
+namespace
+{
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    size_t allocations = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+}
+
+TEST_CASE("Map entries allocate only their node and key")
+{
+    std::string input = "{";
+    for (int i = 0; i < 100; ++i)
+    {
+        // Long enough not to fit in the string itself
+        char key[64];
+        std::snprintf(key, sizeof(key), "\"a rather long key number %03d\": %d, ", i, i);
+        input += key;
+    }
+    input += "\"a rather long key number 000\": -1}";
+
+    CountingResource resource;
+    std::pmr::map<std::pmr::string, int> m(&resource);
+    REQUIRE(from_json_string(input.c_str(), &m, nullptr));
+    REQUIRE(m.size() == 100);
+    CHECK(m.begin()->second == 0);
+    // A long key needs a buffer of its own besides the node, plus there is the buffer the keys
+    // are read into. The duplicate key at the end costs nothing.
+    CHECK(resource.allocations == 2 * 100 + 1);
+
+    input = "{";
+    for (int i = 0; i < 100; ++i)
+        input += "\"k" + std::to_string(i) + "\": [" + std::to_string(i) + "], ";
+    input += "\"k0\": [-1]}";
+    CountingResource short_keys;
+    std::pmr::unordered_map<std::pmr::string, std::pmr::vector<int>> u(&short_keys);
+    u.reserve(200);
+    std::size_t reserved = short_keys.allocations;
+    REQUIRE(from_json_string(input.c_str(), &u, nullptr));
+    REQUIRE(u.size() == 100);
+    CHECK(u["k0"] == std::pmr::vector<int>{0});
+    // A node and the parsed vector per entry, as the short keys live in the node, and the vector
+    // of the duplicate key that is dropped
+    CHECK(short_keys.allocations - reserved == 2 * 100 + 1);
+}
+#endif
+
+TEST_CASE("A failed map value adds no entry")
+{
+    const char* input = R"({"a": 1, "x": "not a number"})";
+    std::map<std::string, int> m;
+    CHECK(!from_json_string(input, &m, nullptr));
+    CHECK(m == std::map<std::string, int>{{"a", 1}});
+
+    std::unordered_map<std::string, int> u;
+    CHECK(!from_json_string(input, &u, nullptr));
+    CHECK(u == std::unordered_map<std::string, int>{{"a", 1}});
+
+    std::multimap<std::string, int> mm;
+    CHECK(!from_json_string(R"({"x": 1, "x": "not a number"})", &mm, nullptr));
+    CHECK(mm == std::multimap<std::string, int>{{"x", 1}});
+
+    // An entry that was there before keeps its value
+    m = {{"a", 1}, {"x", 2}};
+    {
+        ReparseScope scope;
+        CHECK(!from_json_string(R"({"a": 3, "x": "not a number", "y": 4})", &m, nullptr));
+    }
+    CHECK(m == std::map<std::string, int>{{"a", 3}, {"x", 2}});
+}
+
+namespace
+{
+struct Hinted
+{
+    std::vector<int> values;
+    std::vector<std::vector<int>> rows;
+    std::unordered_map<std::string, int> counts;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("values", &values, Flags::Default, 100);
+        h->add_property("rows", &rows, Flags::LearnCapacity);
+        h->add_property("counts", &counts, Flags::Default, 64);
+    }
+};
+}
+
+TEST_CASE("Capacity hints")
+{
+    Hinted hinted;
+    Handler<Hinted> h(&hinted);
+    const char* input = "{\"values\":[1,2,3],\"rows\":[[1,2,3,4,5],[6,7,8,9,10],[11,12,13,14,15]],"
+                        "\"counts\":{\"a\":1}}";
+    REQUIRE(nonpublic::parse_json_string(input, &h, nullptr));
+    CHECK(hinted.values.size() == 3);
+    CHECK(hinted.values.capacity() >= 100);
+    CHECK(hinted.counts.bucket_count() >= 64);
+    // Each row after the first is reserved at the size of the one before
+    CHECK(hinted.rows[1].capacity() == 5);
+    CHECK(hinted.rows[2].capacity() == 5);
+
+    hinted.rows = std::vector<std::vector<int>>();
+    h.prepare_for_reuse();
+    REQUIRE(nonpublic::parse_json_string(input, &h, nullptr));
+    CHECK(hinted.rows.capacity() == 3);
+    CHECK(to_json_string(hinted).find("\"rows\":[[1,2,3,4,5],[6,7,8,9,10],[11,12,13,14,15]]")
+          != std::string::npos);
+}
+
+TEST_CASE("Type names of errors are rendered when asked for")
+{
+    std::vector<std::map<std::string, int>> rows;
+    std::map<std::string, int> row;
+    Handler<std::map<std::string, int>> row_handler(&row);
+
+    ParseStatus status;
+    REQUIRE(!from_json_string("[{\"a\":1},3]", &rows, &status));
+    auto it = std::find_if(status.begin(), status.end(), [](const ErrorBase& e) {
+        return e.type() == error::TYPE_MISMATCH;
+    });
+    REQUIRE(it != status.end());
+    auto&& mismatch = static_cast<const error::TypeMismatchError&>(*it);
+    CHECK(mismatch.expected_type() == row_handler.type_name());
+    CHECK(mismatch.actual_type() == "unsigned");
+    CHECK(status.description().find(quote(row_handler.type_name())) != std::string::npos);
+
+    // More errors than a thread keeps for reuse fall back to the heap
+    ErrorStack stack;
+    for (int i = 0; i < 1000; ++i)
+        stack.push(new error::CustomError("error"));
+    CHECK(stack.size() == 1000);
+
+    // The memory of an error is reused by the next one made on the same thread
+    ErrorBase* first = new error::RequiredFieldMissingError();
+    void* block = first;
+    delete first;
+    ErrorBase* second = new error::CorruptedDOMError();
+    CHECK(static_cast<void*>(second) == block);
+    delete second;
+}
+
+namespace
+{
+struct Reading
+{
+    int value;
+
+    void staticjson_init(ObjectHandler* h) { h->add_property("value", &value); }
+};
+
+struct Batch
+{
+    std::vector<Reading> readings;
+    std::map<std::string, int> tags;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("tags", &tags);
+        h->add_property("readings", &readings);
+    }
+};
+}
+
+TEST_CASE("Code only parse status")
+{
+    Batch batch;
+    ParseStatus status(true);
+    REQUIRE(!from_json_string(
+        "{\"tags\":{\"a\":1},\"readings\":[{\"value\":1},{\"value\":\"x\"}]}", &batch, &status));
+    CHECK(status.error_stack().empty());
+    CHECK(status.error_type() == error::TYPE_MISMATCH);
+    // Fields are numbered in order of name
+    REQUIRE(status.path_length() == 3);
+    CHECK(status.path(0) == 0);
+    CHECK(status.path(1) == 1);
+    CHECK(status.path(2) == 0);
+    CHECK(status.description().find("at path /0/1/0") != std::string::npos);
+
+    REQUIRE(!from_json_string("{\"tags\":{\"a\":1,\"b\":\"x\"}}", &batch, &status));
+    CHECK(status.error_type() == error::TYPE_MISMATCH);
+    REQUIRE(status.path_length() == 2);
+    CHECK(status.path(0) == 1);
+    CHECK(status.path(1) == 1);
+
+    REQUIRE(!from_json_string("{\"readings\":[{}]}", &batch, &status));
+    CHECK(status.error_type() == error::MISSING_REQUIRED);
+
+    REQUIRE(from_json_string("{\"tags\":{},\"readings\":[]}", &batch, &status));
+    CHECK(status.error_type() == error::SUCCESS);
+}
+
+TEST_CASE("Narrow integers")
+{
+    std::vector<std::int16_t> samples;
+    REQUIRE(from_json_string("[-32768, 0, 32767]", &samples, nullptr));
+    CHECK(samples == std::vector<std::int16_t>{-32768, 0, 32767});
+    CHECK(to_json_string(samples) == "[-32768,0,32767]");
+
+    std::tuple<std::int8_t, std::uint8_t, std::uint16_t> small;
+    REQUIRE(from_json_string("[-128, 255, 65535]", &small, nullptr));
+    CHECK(std::get<0>(small) == -128);
+    CHECK(std::get<1>(small) == 255);
+    CHECK(std::get<2>(small) == 65535);
+    CHECK(to_json_string(small) == "[-128,255,65535]");
+
+    ParseStatus status;
+    CHECK(!from_json_string("[40000]", &samples, &status));
+    auto it = std::find_if(status.begin(), status.end(), [](const ErrorBase& e) {
+        return e.type() == error::NUMBER_OUT_OF_RANGE;
+    });
+    REQUIRE(it != status.end());
+    CHECK(static_cast<const error::NumberOutOfRangeError&>(*it).expected_type() == "short");
+
+    std::uint8_t byte;
+    CHECK(!from_json_string("-1", &byte, nullptr));
+    CHECK(!from_json_string("256", &byte, nullptr));
+    CHECK(!from_json_string("1.5", &byte, nullptr));
+}
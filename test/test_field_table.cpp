@@ -0,0 +1,252 @@
+#include <staticjson/staticjson.hpp>
+
+#include "catch.hpp"
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace staticjson;
+
+namespace field_table_test
+{
+struct Address
+{
+    std::string city;
+    int zip = 0;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("city", &city);
+        h->add_property("zip", &zip, Flags::Optional);
+    }
+};
+
+struct Contact
+{
+    std::string kind, value;
+};
+
+struct Person
+{
+    std::string name;
+    unsigned age = 0;
+    bool active = true;
+    Address home;
+    std::vector<Contact> contacts;
+    std::map<std::string, double> scores;
+
+private:
+    int secret = 7;
+
+    friend struct staticjson::FieldsOf<Person>;
+
+public:
+    int get_secret() const { return secret; }
+};
+
+// `Person` registered the usual way, to compare against
+struct ReferencePerson
+{
+    std::string name;
+    unsigned age = 0;
+    bool active = true;
+    Address home;
+    std::vector<std::map<std::string, std::string>> contacts;
+    std::map<std::string, double> scores;
+    int secret = 7;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("name", &name);
+        h->add_property("age", &age);
+        h->add_property("active", &active, Flags::Optional);
+        h->add_property("home", &home, Flags::Optional);
+        h->add_property("contacts", &contacts, Flags::Optional);
+        h->add_property("scores", &scores, Flags::Optional);
+        h->add_property("secret", &secret, Flags::Optional | Flags::IgnoreWrite);
+    }
+};
+}
+
+STATICJSON_FIELDS_WITH_FLAGS(field_table_test::Contact,
+                             Flags::DisallowUnknownKey,
+                             field("kind", &field_table_test::Contact::kind),
+                             field("value", &field_table_test::Contact::value))
+
+STATICJSON_FIELDS(field_table_test::Person,
+                  field("name", &field_table_test::Person::name),
+                  field("age", &field_table_test::Person::age),
+                  field("active", &field_table_test::Person::active, Flags::Optional),
+                  field("home", &field_table_test::Person::home, Flags::Optional),
+                  field("contacts", &field_table_test::Person::contacts, Flags::Optional),
+                  field("scores", &field_table_test::Person::scores, Flags::Optional),
+                  field("secret",
+                        &field_table_test::Person::secret,
+                        Flags::Optional | Flags::IgnoreWrite))
+
+static_assert(FieldsOf<field_table_test::Person>::table().size == 7, "");
+static_assert(FieldsOf<field_table_test::Person>::table().tail.head.name_length == 3, "");
+static_assert(FieldsOf<field_table_test::Contact>::flags() == Flags::DisallowUnknownKey, "");
+
+TEST_CASE("Field tables parse like staticjson_init")
+{
+    using field_table_test::Person;
+    using field_table_test::ReferencePerson;
+
+    const char* inputs[] = {
+        R"({"name": "Ada", "age": 36})",
+        R"({"name": "Ada", "age": 36, "active": false, "home": {"city": "London", "zip": 1},
+            "contacts": [{"kind": "mail", "value": "ada@example.com"}],
+            "scores": {"math": 10, "poetry": 7.5}, "secret": 3, "other": [1, {}]})",
+        R"({"name": "Ada"})",
+        R"({"name": "Ada", "age": -1})",
+        R"({"name": "Ada", "age": 1, "home": {"zip": 1}})",
+        R"({"name": "Ada", "age": 1, "scores": {"x": "y"}})",
+    };
+    for (const char* json : inputs)
+    {
+        CAPTURE(json);
+        Person actual;
+        ReferencePerson expected;
+        ParseStatus actual_status, expected_status;
+        bool success = from_json_string(json, &actual, &actual_status);
+        REQUIRE(success == from_json_string(json, &expected, &expected_status));
+        CHECK(actual_status.description() == expected_status.description());
+        if (!success)
+            continue;
+        CHECK(actual.get_secret() == expected.secret);
+        CHECK(to_json_string(actual.home) == to_json_string(expected.home));
+        CHECK(to_json_string(actual.scores) == to_json_string(expected.scores));
+        CHECK(to_pretty_json_string(actual) == to_pretty_json_string(expected));
+    }
+}
+
+TEST_CASE("Field tables apply object flags")
+{
+    field_table_test::Contact c;
+    ParseStatus status;
+    CHECK(from_json_string(R"({"kind": "a", "value": "b"})", &c, nullptr));
+    CHECK(c.kind == "a");
+    CHECK(c.value == "b");
+    CHECK(!from_json_string(R"({"kind": "a", "value": "b", "extra": 1})", &c, &status));
+    CHECK(status.begin()->type() == error::UNKNOWN_FIELD);
+
+    Document schema = export_json_schema(&c);
+    CHECK(!schema["additionalProperties"].GetBool());
+    CHECK(schema["required"].Size() == 2);
+}
+
+TEST_CASE("Field tables compile their plan from the table")
+{
+    field_table_test::Person person;
+    const nonpublic::ParsePlan* plan = nonpublic::parse_plan_of(&person);
+    REQUIRE(plan);
+    CHECK(plan->find_in_table);
+    REQUIRE(plan->fields.size() == 7);
+    // Sorted like the fields of an `ObjectHandler`
+    CHECK(std::string(plan->fields.front().name, plan->fields.front().name_length) == "active");
+
+    const nonpublic::PlanField* age = plan->find("age", 3);
+    REQUIRE(age);
+    CHECK(age->offset
+          == static_cast<std::size_t>(reinterpret_cast<char*>(&person.age)
+                                      - reinterpret_cast<char*>(&person)));
+    CHECK(std::string(age->quoted_name, age->quoted_name_length) == "\"age\"");
+    CHECK(!plan->find("ag", 2));
+    CHECK(!plan->find("ages", 4));
+    CHECK(plan->find("secret", 6));
+
+    const nonpublic::PlanField* home = plan->find("home", 4);
+    REQUIRE(home);
+    // `Address` uses `staticjson_init`, so its plan is looked up by name
+    REQUIRE(home->sub_plan);
+    CHECK(!home->sub_plan->find_in_table);
+    CHECK(home->sub_plan->find("zip", 3));
+}
+
+namespace field_table_test
+{
+// Names that share their length, first character or a long prefix
+struct Readings
+{
+    int s = 0, t = 0, sensor = 0, sensors = 0, sensor_a = 0, sensor_b = 0, sensor_c = 0,
+        sensor_aa = 0, sensor_ab = 0, sensor_ba = 0, sensor_bb = 0, sensor_a_min = 0,
+        sensor_a_max = 0, sensor_b_min = 0, sensor_b_max = 0, tensor_a = 0, tensor_b = 0,
+        unit = 0;
+};
+}
+
+STATICJSON_FIELDS_WITH_FLAGS(field_table_test::Readings,
+                             Flags::DisallowUnknownKey,
+                             field("s", &field_table_test::Readings::s),
+                             field("t", &field_table_test::Readings::t),
+                             field("sensor", &field_table_test::Readings::sensor),
+                             field("sensors", &field_table_test::Readings::sensors),
+                             field("sensor_a", &field_table_test::Readings::sensor_a),
+                             field("sensor_b", &field_table_test::Readings::sensor_b),
+                             field("sensor_c", &field_table_test::Readings::sensor_c),
+                             field("sensor_aa", &field_table_test::Readings::sensor_aa),
+                             field("sensor_ab", &field_table_test::Readings::sensor_ab),
+                             field("sensor_ba", &field_table_test::Readings::sensor_ba),
+                             field("sensor_bb", &field_table_test::Readings::sensor_bb),
+                             field("sensor_a_min", &field_table_test::Readings::sensor_a_min),
+                             field("sensor_a_max", &field_table_test::Readings::sensor_a_max),
+                             field("sensor_b_min", &field_table_test::Readings::sensor_b_min),
+                             field("sensor_b_max", &field_table_test::Readings::sensor_b_max),
+                             field("tensor_a", &field_table_test::Readings::tensor_a),
+                             field("tensor_b", &field_table_test::Readings::tensor_b),
+                             field("unit", &field_table_test::Readings::unit))
+
+TEST_CASE("Field tables find keys among many similar names")
+{
+    using field_table_test::Readings;
+
+    const char* names[] = {"s",
+                           "t",
+                           "sensor",
+                           "sensors",
+                           "sensor_a",
+                           "sensor_b",
+                           "sensor_c",
+                           "sensor_aa",
+                           "sensor_ab",
+                           "sensor_ba",
+                           "sensor_bb",
+                           "sensor_a_min",
+                           "sensor_a_max",
+                           "sensor_b_min",
+                           "sensor_b_max",
+                           "tensor_a",
+                           "tensor_b",
+                           "unit"};
+    std::string json = "{";
+    for (std::size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        SizeType length = static_cast<SizeType>(std::strlen(names[i]));
+        CHECK(nonpublic::find_table_field<Readings>(names[i], length) == i);
+        if (i)
+            json += ", ";
+        json += "\"" + std::string(names[i]) + "\": " + std::to_string(i + 1);
+    }
+    json += "}";
+
+    for (const char* unknown : {"", "u", "sensor_", "sensor_d", "sensor_a_mid", "sensorss", "x"})
+    {
+        CAPTURE(unknown);
+        SizeType length = static_cast<SizeType>(std::strlen(unknown));
+        CHECK(nonpublic::find_table_field<Readings>(unknown, length)
+              == nonpublic::ParsePlan::no_field);
+    }
+
+    Readings r;
+    REQUIRE(from_json_string(json.c_str(), &r, nullptr));
+    CHECK(r.s == 1);
+    CHECK(r.sensor == 3);
+    CHECK(r.sensor_ab == 9);
+    CHECK(r.sensor_a_max == 13);
+    CHECK(r.tensor_b == 17);
+    CHECK(r.unit == 18);
+    CHECK(!from_json_string(R"({"sensor_d": 1})", &r, nullptr));
+}
@@ -5,6 +5,7 @@
 #include <staticjson/staticjson.hpp>
 
 #include <rapidjson/schema.h>
+#include <rapidjson/stringbuffer.h>
 
 #include <cerrno>
 #include <cstdio>
@@ -619,6 +620,16 @@ TEST_CASE("Test for writing JSON", "[serialization]")
     }
 
     REQUIRE(users == reparsed_users);
+
+    // The templated writers must agree with the type erased ones
+    Handler<std::vector<User>> h(&users);
+    REQUIRE(json_output == nonpublic::serialize_pretty_json_string(&h));
+    REQUIRE(to_json_string(users) == nonpublic::serialize_json_string(&h));
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    REQUIRE(write_json(writer, users));
+    REQUIRE(std::string(buffer.GetString(), buffer.GetSize()) == to_json_string(users));
 }
 
 static bool is_valid_json(const std::string& filename, rapidjson::SchemaValidator* validator)
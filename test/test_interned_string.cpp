@@ -0,0 +1,89 @@
+#include <staticjson/staticjson.hpp>
+
+#include "catch.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace staticjson;
+
+namespace
+{
+struct Event
+{
+    InternedString country;
+    InternedString type;
+    std::unordered_map<InternedString, int> counts;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("country", &country);
+        h->add_property("type", &type);
+        h->add_property("counts", &counts, Flags::Optional);
+    }
+};
+}
+
+TEST_CASE("Interned strings share equal values")
+{
+    InternTable table;
+    InternTableScope scope(&table);
+
+    std::vector<Event> events;
+    REQUIRE(from_json_string(R"([{"country": "NZ", "type": "click", "counts": {"a": 1}},
+        {"country": "NZ", "type": "view", "counts": {"a": 2, "b": 3}},
+        {"country": "FR", "type": "click"}])",
+                             &events,
+                             nullptr));
+    REQUIRE(events.size() == 3);
+    CHECK(events[0].country.data() == events[1].country.data());
+    CHECK(events[0].type.data() == events[2].type.data());
+    CHECK(events[1].counts.at(InternedString("b")) == 3);
+    CHECK(events[0].counts.begin()->first.data()
+          == events[1].counts.find(InternedString("a"))->first.data());
+    CHECK(to_json_string(events[2]) == R"({"country":"FR","counts":{},"type":"click"})");
+
+    InternStats stats = table.stats();
+    CHECK(stats.entries == 6);
+    CHECK(stats.misses == 6);
+    CHECK(stats.hits >= 4);
+    CHECK(stats.bytes == std::string("NZclickviewabFR").size());
+}
+
+TEST_CASE("Intern tables are bounded")
+{
+    InternTableOptions options;
+    options.max_entries = 2;
+    options.shards = 1;
+    options.max_length = 8;
+
+    InternTable fixed(options);
+    InternedString a = fixed.intern("a"), b = fixed.intern("b"), c = fixed.intern("c");
+    CHECK(c.str() == "c");
+    CHECK(fixed.intern("c").data() != c.data());
+    CHECK(fixed.intern("a").data() == a.data());
+    CHECK(fixed.intern("much too long").str() == "much too long");
+    CHECK(fixed.stats().entries == 2);
+    CHECK(fixed.stats().rejected == 3);
+
+    options.make_policy = [] {
+        return std::unique_ptr<InternEvictionPolicy>(new LruEvictionPolicy());
+    };
+    InternTable lru(options);
+    a = lru.intern("a");
+    b = lru.intern("b");
+    CHECK(lru.intern("a").data() == a.data());
+    c = lru.intern("c");
+    CHECK(lru.stats().evictions == 1);
+    CHECK(lru.intern("a").data() == a.data());
+    CHECK(lru.intern("c").data() == c.data());
+    // Evicted values stay valid
+    CHECK(b.str() == "b");
+    CHECK(lru.intern("b").data() != b.data());
+    CHECK(lru.intern("b") == b);
+
+    lru.clear();
+    CHECK(lru.stats().entries == 0);
+    CHECK(a.str() == "a");
+}
@@ -52,15 +52,451 @@ TEST_CASE("Test memory usage")
     }
     Handler<std::vector<Struct>> h(&structs);
     serialized = nonpublic::serialize_json_string(&h);
+
+    // The first parse creates the handlers of the fields as their keys are seen
+    structs.clear();
+    h.prepare_for_reuse();
+    ParseStatus status;
+    REQUIRE(nonpublic::parse_json_string(serialized.c_str(), &h, &status));
     memory_usage_before = h.get_internal_handler().get_memory_pool().Capacity();
 
     structs.clear();
     h.prepare_for_reuse();
 
-    ParseStatus status;
     REQUIRE(nonpublic::parse_json_string(serialized.c_str(), &h, &status));
     memory_usage_after = h.get_internal_handler().get_memory_pool().Capacity();
 
     printf("Memory usage: before %zu, after %zu\n", memory_usage_before, memory_usage_after);
     CHECK(memory_usage_before == memory_usage_after);
 }
+
+TEST_CASE("Handlers take their memory from the active arena")
+{
+    std::vector<Struct> structs(10);
+    for (size_t i = 0; i < structs.size(); ++i)
+    {
+        structs[i].name = "Struct" + std::to_string(i);
+        structs[i].complex_values.resize(i);
+    }
+    std::string serialized = to_json_string(structs);
+
+    Arena arena;
+    size_t capacity = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        {
+            ArenaScope scope(&arena);
+            CHECK(ArenaScope::current() == &arena);
+            std::vector<Struct> parsed;
+            ParseStatus status;
+            REQUIRE(from_json_string(serialized.c_str(), &parsed, &status));
+            CHECK(to_json_string(parsed) == serialized);
+            CHECK(arena.capacity() > 0);
+        }
+        CHECK(ArenaScope::current() == nullptr);
+        CHECK(arena.in_use() == 0);
+        if (i == 0)
+            capacity = arena.capacity();
+        else
+            CHECK(arena.capacity() == capacity);
+        arena.reset();
+        CHECK(arena.capacity() == capacity);
+    }
+
+    {
+        ArenaScope scope(&arena);
+        Handler<std::vector<Struct>> h(&structs);
+        CHECK(arena.in_use() > 0);
+        arena.reset();
+        CHECK(to_json_string(structs) == serialized);
+    }
+    CHECK(arena.in_use() == 0);
+}
+
+namespace
+{
+struct Leaf
+{
+    std::string name;
+    std::unique_ptr<Leaf> next;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("name", &name);
+        h->add_property("next", &next, Flags::Optional);
+    }
+};
+
+struct Tree
+{
+    Leaf left, right;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("left", &left);
+        h->add_property("right", &right);
+    }
+};
+}
+
+TEST_CASE("Handlers keep the arena they were built under")
+{
+    const char* json = R"({"left":{"name":"a","next":{"name":"b","next":null}},)"
+                       R"("right":{"name":"c","next":null}})";
+    Tree tree;
+    Handler<Tree> h(&tree);
+    {
+        // The field and pointee handlers are created during this parse, but must come from the
+        // heap like the handler that creates them
+        Arena arena;
+        ArenaScope scope(&arena);
+        REQUIRE(nonpublic::parse_json_string(json, &h, nullptr));
+        CHECK(arena.in_use() == 0);
+    }
+    CHECK(nonpublic::serialize_json_string(&h) == json);
+
+    Arena arena;
+    Tree other;
+    std::unique_ptr<Handler<Tree>> built_in_arena;
+    {
+        ArenaScope scope(&arena);
+        built_in_arena.reset(new Handler<Tree>(&other));
+    }
+    std::size_t in_use = arena.in_use();
+    REQUIRE(nonpublic::parse_json_string(json, built_in_arena.get(), nullptr));
+    CHECK(arena.in_use() > in_use);
+    built_in_arena.reset();
+    CHECK(arena.in_use() == 0);
+}
+
+TEST_CASE("Arenas may be backed by huge pages")
+{
+    ArenaOptions options;
+    options.huge_pages = true;
+    Arena arena(options);
+    ArenaScope scope(&arena);
+
+    std::vector<Struct> structs(3);
+    std::string serialized = to_json_string(structs);
+    std::vector<Struct> parsed;
+    REQUIRE(from_json_string(serialized.c_str(), &parsed, nullptr));
+    CHECK(to_json_string(parsed) == serialized);
+    CHECK(arena.capacity() >= options.block_size);
+}
+
+namespace
+{
+struct PooledNode;
+
+// Hands out nodes from a fixed buffer, counting how many are live
+struct NodePool
+{
+    static std::vector<PooledNode*> free_nodes;
+    static int live;
+};
+
+std::vector<PooledNode*> NodePool::free_nodes;
+int NodePool::live = 0;
+
+struct NodeDeleter
+{
+    void operator()(PooledNode* node) const noexcept;
+};
+
+struct PooledNode
+{
+    int value = 0;
+    std::unique_ptr<PooledNode, NodeDeleter> next;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("value", &value);
+        h->add_property("next", &next, Flags::Optional);
+    }
+};
+
+void NodeDeleter::operator()(PooledNode* node) const noexcept
+{
+    node->~PooledNode();
+    NodePool::free_nodes.push_back(node);
+    --NodePool::live;
+}
+}
+
+namespace staticjson
+{
+template <>
+struct PointeeFactory<std::unique_ptr<PooledNode, NodeDeleter>>
+{
+    static void create(std::unique_ptr<PooledNode, NodeDeleter>* p)
+    {
+        REQUIRE(!NodePool::free_nodes.empty());
+        PooledNode* node = NodePool::free_nodes.back();
+        NodePool::free_nodes.pop_back();
+        ++NodePool::live;
+        p->reset(new (node) PooledNode());
+    }
+};
+}
+
+TEST_CASE("Pointees and pointer handlers are pooled")
+{
+    std::vector<PooledNode> storage(100);
+    for (PooledNode& n : storage)
+        NodePool::free_nodes.push_back(&n);
+
+    std::string json = "{\"value\": 0}";
+    for (int i = 1; i < 50; ++i)
+        json = "{\"value\": " + std::to_string(i) + ", \"next\": " + json + "}";
+
+    Arena arena;
+    {
+        ArenaScope scope(&arena);
+        PooledNode head;
+        REQUIRE(from_json_string(json.c_str(), &head, nullptr));
+        CHECK(NodePool::live == 49);
+        CHECK(head.next->next->value == 47);
+
+        // The handler follows the pointer when it is replaced before writing
+        Handler<std::unique_ptr<PooledNode, NodeDeleter>> h(&head.next);
+        CHECK(nonpublic::serialize_json_string(&h).find("\"value\":48") != std::string::npos);
+        head.next = std::move(head.next->next);
+        CHECK(nonpublic::serialize_json_string(&h).find("\"value\":47") != std::string::npos);
+        head.next.reset();
+        CHECK(nonpublic::serialize_json_string(&h) == "null");
+    }
+    CHECK(NodePool::live == 0);
+    CHECK(arena.in_use() == 0);
+    NodePool::free_nodes.clear();
+}
+
+namespace
+{
+struct Reading
+{
+    std::string name;
+    std::vector<double> values;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("name", &name);
+        h->add_property("values", &values);
+    }
+};
+
+struct Snapshot
+{
+    std::vector<Reading> readings;
+    std::unordered_map<std::string, std::vector<int>> groups;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("readings", &readings);
+        h->add_property("groups", &groups);
+    }
+};
+}
+
+TEST_CASE("Reparsing in place keeps the memory of existing elements")
+{
+    Snapshot s;
+    REQUIRE(from_json_string(R"({"readings": [
+            {"name": "a sensor with a rather long name", "values": [1, 2, 3, 4]},
+            {"name": "b", "values": [5]},
+            {"name": "c", "values": []}],
+        "groups": {"kept": [1, 2, 3], "dropped": [4]}})",
+                             &s,
+                             nullptr));
+    const char* name = s.readings[0].name.data();
+    const double* values = s.readings[0].values.data();
+    const Reading* readings = s.readings.data();
+    const int* kept = s.groups["kept"].data();
+
+    {
+        ReparseScope scope;
+        REQUIRE(from_json_string(R"({"readings": [
+                {"name": "another sensor with a long name", "values": [9, 8]},
+                {"name": "b2", "values": [7, 6, 5]}],
+            "groups": {"new": [0], "kept": [3, 2]}})",
+                                 &s,
+                                 nullptr));
+    }
+    REQUIRE(s.readings.size() == 2);
+    CHECK(s.readings.data() == readings);
+    CHECK(s.readings[0].name == "another sensor with a long name");
+    CHECK(s.readings[0].name.data() == name);
+    CHECK(s.readings[0].values == std::vector<double>{9, 8});
+    CHECK(s.readings[0].values.data() == values);
+    CHECK(s.readings[1].values == std::vector<double>{7, 6, 5});
+    REQUIRE(s.groups.size() == 2);
+    CHECK(s.groups.count("dropped") == 0);
+    CHECK(s.groups["kept"] == std::vector<int>{3, 2});
+    CHECK(s.groups["kept"].data() == kept);
+    CHECK(s.groups["new"] == std::vector<int>{0});
+
+    // Growing appends after the reused elements
+    {
+        ReparseScope scope;
+        REQUIRE(from_json_string(
+            R"({"readings": [{"name": "x", "values": []}, {"name": "y", "values": []},
+                {"name": "z", "values": [1]}], "groups": {}})",
+            &s,
+            nullptr));
+    }
+    REQUIRE(s.readings.size() == 3);
+    CHECK(s.readings[2].name == "z");
+    CHECK(s.groups.empty());
+
+    // A duplicate key keeps its first value, as in a fresh parse
+    const char* duplicates = R"({"readings": [], "groups": {"a": [1], "b": [2], "a": [3]}})";
+    Snapshot fresh;
+    REQUIRE(from_json_string(duplicates, &fresh, nullptr));
+    CHECK(fresh.groups["a"] == std::vector<int>{1});
+    s.groups["a"] = {0};
+    s.groups["c"] = {0};
+    {
+        ReparseScope scope;
+        REQUIRE(from_json_string(duplicates, &s, nullptr));
+    }
+    CHECK(s.groups == fresh.groups);
+}
+
+TEST_CASE("Memory taken by a parse is counted and may be capped")
+{
+    std::string input = "[";
+    for (int i = 0; i < 100; ++i)
+    {
+        if (i)
+            input += ',';
+        input += "\"a string too long to be stored inline\"";
+    }
+    input += ']';
+
+    std::vector<std::string> strings;
+    ParseStatus status;
+    REQUIRE(from_json_string(input.c_str(), &strings, &status));
+    const MemoryUsage& usage = status.memory_usage();
+    CHECK(usage.bytes >= 100 * (strings[0].size() + sizeof(std::string)));
+    CHECK(usage.allocations >= 200);
+    CHECK(usage.peak > 0);
+    CHECK(usage.peak <= usage.bytes);
+
+    std::size_t budget = usage.peak / 2;
+    status.set_memory_budget(budget);
+    REQUIRE(!from_json_string(input.c_str(), &strings, &status));
+    REQUIRE(!status.error_stack().empty());
+    CHECK(status.begin()->type() == error::MEMORY_BUDGET_EXCEEDED);
+    CHECK(status.memory_usage().peak < budget + 1000);
+
+    ParseStatus code_only(true);
+    code_only.set_memory_budget(budget);
+    REQUIRE(!from_json_string(input.c_str(), &strings, &code_only));
+    CHECK(code_only.error_type() == error::MEMORY_BUDGET_EXCEEDED);
+}
+
+TEST_CASE("Handler chunks count against the budget while they are held")
+{
+    std::string items = "[";
+    for (int i = 0; i < 1000; ++i)
+    {
+        if (i)
+            items += ',';
+        items += "{\"name\":\"n\"}";
+    }
+    items += ']';
+
+    // The handler of each pointee is freed when the next one is created
+    std::vector<std::unique_ptr<Leaf>> leaves;
+    ParseStatus status;
+    REQUIRE(from_json_string(items.c_str(), &leaves, &status));
+    CHECK(status.memory_usage().peak < status.memory_usage().bytes / 10);
+
+    // A list nests its handlers, so that they are all held at once
+    std::string list = "null";
+    for (int i = 0; i < 2000; ++i)
+        list = "{\"name\":\"n\",\"next\":" + list + "}";
+    std::unique_ptr<Leaf> head;
+    status.set_memory_budget(1000);
+    REQUIRE(!from_json_string(list.c_str(), &head, &status));
+    REQUIRE(!status.error_stack().empty());
+    CHECK(status.begin()->type() == error::MEMORY_BUDGET_EXCEEDED);
+
+    Handler<std::unique_ptr<Leaf>> h(&head);
+    REQUIRE(!nonpublic::parse_json_string(list.c_str(), &h, &status));
+    REQUIRE(!status.error_stack().empty());
+    CHECK(status.begin()->type() == error::MEMORY_BUDGET_EXCEEDED);
+
+    status.set_memory_budget(0);
+    REQUIRE(from_json_string(list.c_str(), &head, &status));
+    CHECK(head->next->next->name == "n");
+
+    // Only handlers built while memory is counted take chunks that carry their size
+    Arena arena;
+    ArenaScope scope(&arena);
+    CHECK(mempool::current_chunk_allocator() == arena.chunk_allocator());
+    {
+        nonpublic::MemoryAccountScope account(&status);
+        CHECK(mempool::current_chunk_allocator() == arena.chunk_allocator(true));
+    }
+    {
+        nonpublic::MemoryAccountScope account(nullptr);
+        CHECK(mempool::current_chunk_allocator() == arena.chunk_allocator());
+    }
+}
+
+namespace
+{
+struct Category
+{
+    std::string name;
+    std::vector<Category> subcategories;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("name", &name);
+        h->add_property("subcategories", &subcategories);
+    }
+};
+
+const FootprintNode* find_part(const FootprintNode& node, const std::string& name)
+{
+    for (const FootprintNode& child : node.children)
+    {
+        if (child.name == name)
+            return &child;
+    }
+    return nullptr;
+}
+}
+
+TEST_CASE("Footprint of a handler tree")
+{
+    HandlerFootprint footprint = handler_footprint<Struct>();
+    CAPTURE(footprint.description());
+    const FootprintNode& root = footprint.root;
+    CHECK(root.type == "object");
+    CHECK(root.total_bytes() > sizeof(Handler<Struct>));
+
+    const FootprintNode* fields = find_part(root, "field map");
+    REQUIRE(fields);
+    CHECK(fields->objects == 3);
+
+    const FootprintNode* simple = find_part(root, "simple");
+    REQUIRE(simple);
+    const FootprintNode* floats = find_part(*simple, "floats");
+    REQUIRE(floats);
+    CHECK(floats->type == "std::vector<float>");
+    const FootprintNode* element = find_part(*floats, "element handler");
+    REQUIRE(element);
+    CHECK(element->bytes == sizeof(Handler<float>));
+
+    // Recursive types are described down to their first repetition
+    HandlerFootprint recursive = handler_footprint<Category>();
+    const FootprintNode* subcategories = find_part(recursive.root, "subcategories");
+    REQUIRE(subcategories);
+    const FootprintNode* category = find_part(*subcategories, "element handler");
+    REQUIRE(category);
+    const FootprintNode* nested = find_part(*category, "subcategories");
+    REQUIRE(nested);
+    CHECK(nested->type == "(recursive)");
+}
@@ -0,0 +1,449 @@
+#include <staticjson/staticjson.hpp>
+
+#include "../src/string_escape.hpp"
+#include "catch.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace staticjson;
+
+namespace
+{
+struct Record
+{
+    std::string name;
+    std::vector<int> values;
+    std::map<std::string, double> scores;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("name", &name);
+        h->add_property("values", &values);
+        h->add_property("scores", &scores);
+    }
+};
+
+std::vector<Record> make_records(size_t count)
+{
+    std::vector<Record> records(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        records[i].name = "record \"" + std::to_string(i) + "\"\n";
+        for (int j = 0; j < 20; ++j)
+            records[i].values.push_back(j * static_cast<int>(i));
+        records[i].scores["score" + std::to_string(i)] = i * 0.5;
+    }
+    return records;
+}
+
+struct OddKeys
+{
+    int a = 1, b = 2, c = 3, d = 4;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("plain", &a);
+        h->add_property("quote\" and \\ backslash", &b);
+        h->add_property(std::string("control\x01\n\x7f", 10), &c);
+        h->add_property("unicode \xe2\x86\x92 /", &d);
+    }
+};
+
+struct Celsius
+{
+    double degrees;
+};
+}
+
+namespace staticjson
+{
+// Overrides `write` but inherits the templated `write_to` of Handler<double>, which must then not
+// be used.
+template <>
+class Handler<Celsius> : public Handler<double>
+{
+private:
+    Celsius* m_celsius;
+
+public:
+    explicit Handler(Celsius* c) : Handler<double>(&c->degrees), m_celsius(c) {}
+
+    bool write(IHandler* output) const override
+    {
+        std::string str = to_json_string(m_celsius->degrees) + "C";
+        return output->String(str.data(), static_cast<SizeType>(str.size()), true);
+    }
+
+    std::string type_name() const override { return "Celsius"; }
+};
+}
+
+namespace
+{
+class CountingSink : public IOutputSink
+{
+public:
+    std::string data;
+    size_t calls = 0;
+
+    bool write(const char* buf, size_t size) override
+    {
+        ++calls;
+        data.append(buf, size);
+        return true;
+    }
+};
+
+class FailingSink : public IOutputSink
+{
+public:
+    bool write(const char*, size_t) override { return false; }
+};
+}
+
+TEST_CASE("Output sinks")
+{
+    auto records = make_records(500);
+    std::string expected = to_json_string(records);
+    std::string expected_pretty = to_pretty_json_string(records);
+
+    SECTION("std::string")
+    {
+        std::string out = "prefix";
+        StringSink sink(&out);
+        REQUIRE(to_json_sink(&sink, records));
+        REQUIRE(out == "prefix" + expected);
+    }
+
+    SECTION("std::vector<char>")
+    {
+        std::vector<char> out;
+        VectorSink sink(&out);
+        REQUIRE(to_pretty_json_sink(&sink, records));
+        REQUIRE(std::string(out.begin(), out.end()) == expected_pretty);
+    }
+
+    SECTION("User defined sink receives chunks")
+    {
+        CountingSink sink;
+        REQUIRE(to_json_sink(&sink, records));
+        REQUIRE(sink.data == expected);
+        REQUIRE(sink.calls < expected.size() / 1000);
+    }
+
+    SECTION("Sink failure")
+    {
+        FailingSink sink;
+        REQUIRE(!to_json_sink(&sink, records));
+    }
+
+    std::vector<Record> parsed;
+    REQUIRE(from_json_string(expected.c_str(), &parsed, nullptr));
+    REQUIRE(parsed.size() == records.size());
+    REQUIRE(parsed.back().name == records.back().name);
+}
+
+TEST_CASE("Escaping of object keys")
+{
+    std::vector<OddKeys> objects(2);
+    std::string json = to_json_string(objects);
+    REQUIRE(json
+            == "[{\"control\\u0001\\n\x7f\":3,\"plain\":1,\"quote\\\" and \\\\ backslash\":2,"
+               "\"unicode \xe2\x86\x92 /\":4},{\"control\\u0001\\n\x7f\":3,\"plain\":1,"
+               "\"quote\\\" and \\\\ backslash\":2,\"unicode \xe2\x86\x92 /\":4}]");
+
+    Document d;
+    REQUIRE(to_json_document(&d, objects, nullptr));
+    REQUIRE(d[1]["quote\" and \\ backslash"] == 2);
+    REQUIRE(to_json_string(d) == json);
+
+    std::vector<OddKeys> parsed;
+    REQUIRE(from_json_string(to_pretty_json_string(objects).c_str(), &parsed, nullptr));
+    REQUIRE(parsed.size() == 2);
+}
+
+static std::string reference_escape(const std::string& str)
+{
+    std::string result = "\"";
+    for (char ch : str)
+    {
+        unsigned char c = static_cast<unsigned char>(ch);
+        switch (c)
+        {
+        case '"':
+            result += "\\\"";
+            break;
+        case '\\':
+            result += "\\\\";
+            break;
+        case '\b':
+            result += "\\b";
+            break;
+        case '\t':
+            result += "\\t";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        case '\f':
+            result += "\\f";
+            break;
+        case '\r':
+            result += "\\r";
+            break;
+        default:
+            if (c < 0x20)
+            {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04X", c);
+                result += buffer;
+            }
+            else
+                result += ch;
+        }
+    }
+    return result + "\"";
+}
+
+TEST_CASE("String escaping")
+{
+    const char specials[] = {'"', '\\', '\n', '\x01', '\x1f', '\x7f', '\x80', '\xff', ' ', '\0'};
+    for (size_t length = 0; length < 80; ++length)
+    {
+        for (size_t pos = 0; pos < length; ++pos)
+        {
+            for (char special : specials)
+            {
+                std::string str(length, 'a');
+                str[pos] = special;
+                str[length - 1 - pos / 2] = specials[pos % sizeof(specials)];
+                std::string expected = reference_escape(str);
+                REQUIRE(to_json_string(str) == expected);
+                REQUIRE(serialized_size(str) == expected.size());
+
+                std::string parsed;
+                REQUIRE(from_json_string(expected.c_str(), &parsed, nullptr));
+                REQUIRE(parsed == str);
+            }
+        }
+    }
+    std::string long_string(100000, 'x');
+    long_string[77777] = '\t';
+    REQUIRE(to_json_string(long_string) == reference_escape(long_string));
+    REQUIRE(to_pretty_json_string(std::vector<std::string>{long_string})
+            == "[\n    " + reference_escape(long_string) + "\n]\n");
+}
+
+TEST_CASE("Escape search kernels")
+{
+    std::vector<nonpublic::FindJsonEscapeFunction> kernels{&nonpublic::find_json_escape_scalar};
+    if (auto f = nonpublic::get_find_json_escape_sse2())
+        kernels.push_back(f);
+    if (auto f = nonpublic::get_find_json_escape_avx2())
+        kernels.push_back(f);
+
+    std::string str(200, 'z');
+    str[150] = '\x80';
+    for (size_t begin = 0; begin < 40; ++begin)
+    {
+        for (size_t pos = begin; pos < 120; ++pos)
+        {
+            for (char special : {'"', '\\', '\x00', '\x1f'})
+            {
+                char saved = str[pos];
+                str[pos] = special;
+                for (auto kernel : kernels)
+                {
+                    REQUIRE(kernel(str.data() + begin, str.data() + str.size())
+                            == str.data() + pos);
+                    REQUIRE(kernel(str.data() + begin, str.data() + pos) == str.data() + pos);
+                }
+                str[pos] = saved;
+            }
+        }
+    }
+}
+
+TEST_CASE("Templated writers defer to overridden write")
+{
+    std::vector<Celsius> temperatures{{20.5}, {-3}};
+    REQUIRE(to_json_string(temperatures) == "[\"20.5C\",\"-3.0C\"]");
+    Handler<std::vector<Celsius>> h(&temperatures);
+    REQUIRE(to_pretty_json_string(temperatures) == nonpublic::serialize_pretty_json_string(&h));
+
+    // Other handlers write through the same body on both paths
+    auto records = make_records(10);
+    Handler<std::vector<Record>> records_handler(&records);
+    REQUIRE(nonpublic::serialize_json_string(&records_handler) == to_json_string(records));
+    OddKeys odd;
+    Handler<OddKeys> odd_handler(&odd);
+    REQUIRE(nonpublic::serialize_json_string(&odd_handler) == to_json_string(odd));
+}
+
+TEST_CASE("Serialized size")
+{
+    auto records = make_records(100);
+    records[3].name = "control \x01\x1f and unicode \xe2\x86\x92";
+    records[4].scores["tiny"] = 1.5e-300;
+
+    size_t size = serialized_size(records);
+    REQUIRE(size == to_json_string(records).size());
+    REQUIRE(serialized_pretty_size(records) == to_pretty_json_string(records).size());
+    REQUIRE(serialized_size(std::vector<int>()) == 2);
+    REQUIRE(serialized_pretty_size(42) == 3);
+
+    std::string out;
+    out.reserve(size);
+    const char* data = out.data();
+    StringSink sink(&out);
+    REQUIRE(to_json_sink(&sink, records));
+    REQUIRE(out.size() == size);
+    REQUIRE(out.data() == data);
+}
+
+TEST_CASE("Shortest float output")
+{
+    REQUIRE(to_json_string(0.1f) == "0.1");
+    REQUIRE(to_json_string(-2.5f) == "-2.5");
+    REQUIRE(to_json_string(1.0f) == "1.0");
+    REQUIRE(to_json_string(0.0f) == "0.0");
+    REQUIRE(to_json_string(1e30f) == "1e30");
+    REQUIRE(to_json_string(std::numeric_limits<float>::max()) == "3.4028235e38");
+    REQUIRE(to_json_string(std::numeric_limits<float>::denorm_min()) == "1e-45");
+    REQUIRE(to_json_string(0.1) == "0.1");
+
+    std::vector<float> floats;
+    std::uint32_t bits = 1;
+    while (bits < 0x7F800000)
+    {
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        floats.push_back(f);
+        floats.push_back(-f);
+        bits += 0x7F801;
+    }
+    floats.push_back(0.3f);
+    floats.push_back(16777216.0f);
+
+    std::string json = to_json_string(floats);
+    std::vector<float> parsed;
+    ParseStatus status;
+    REQUIRE(from_json_string(json.c_str(), &parsed, &status));
+    REQUIRE(parsed == floats);
+    REQUIRE(json.find("0.3,") != std::string::npos);
+
+    Handler<std::vector<float>> h(&floats);
+    REQUIRE(nonpublic::serialize_json_string(&h) == json);
+    REQUIRE(serialized_size(floats) == json.size());
+
+    float nan = std::numeric_limits<float>::quiet_NaN();
+    std::string out;
+    StringSink sink(&out);
+    REQUIRE(!to_json_sink(&sink, nan));
+
+    GlobalConfig::getInstance()->setMaxDecimalPlaces(2);
+    std::string truncated = to_json_string(std::vector<float>{3.14159f, 0.001f, 12.0f});
+    std::string truncated_map = to_json_string(std::map<std::string, float>{{"pi", 3.14159f}});
+    GlobalConfig::getInstance()->setMaxDecimalPlaces(324);
+    REQUIRE(truncated == "[3.14,0.0,12.0]");
+    REQUIRE(truncated_map == "{\"pi\":3.14}");
+}
+
+TEST_CASE("Caller provided buffers")
+{
+    auto records = make_records(50);
+    std::string expected = to_json_string(records);
+    std::string expected_pretty = to_pretty_json_string(records);
+
+    std::vector<char> buffer(expected_pretty.size() + 16, '#');
+    REQUIRE(to_json_buffer(buffer.data(), buffer.size(), records) == expected.size());
+    REQUIRE(std::string(buffer.data(), expected.size()) == expected);
+    REQUIRE(buffer[expected.size()] == '#');
+
+    REQUIRE(to_pretty_json_buffer(buffer.data(), buffer.size(), records)
+            == expected_pretty.size());
+    REQUIRE(std::string(buffer.data(), expected_pretty.size()) == expected_pretty);
+
+    std::fill(buffer.begin(), buffer.end(), '#');
+    REQUIRE(to_json_buffer(buffer.data(), 10, records) == expected.size());
+    REQUIRE(std::string(buffer.data(), 10) == expected.substr(0, 10));
+    REQUIRE(buffer[10] == '#');
+
+    std::vector<std::vector<std::vector<int>>> deep(1, std::vector<std::vector<int>>(1, {1}));
+    char small[16];
+    REQUIRE(to_json_buffer(small, sizeof(small), deep) == 7);
+    REQUIRE(std::string(small, 7) == "[[[1]]]");
+
+    std::string out = "{\"records\":";
+    out.reserve(out.size() + expected.size() + 1);
+    const char* data = out.data();
+    REQUIRE(append_json(out, records));
+    out += '}';
+    REQUIRE(out == "{\"records\":" + expected + "}");
+    REQUIRE(out.data() == data);
+}
+
+#ifndef _WIN32
+static std::string read_whole(std::FILE* fp)
+{
+    std::string content;
+    char buffer[4096];
+    std::rewind(fp);
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        content.append(buffer, n);
+    return content;
+}
+
+TEST_CASE("File descriptor output")
+{
+    auto records = make_records(2000);
+    std::string expected = to_json_string(records);
+    std::string expected_pretty = to_pretty_json_string(records);
+
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> fp(std::tmpfile(), &std::fclose);
+    REQUIRE(fp);
+    int fd = fileno(fp.get());
+
+    FdOutputOptions options;
+    SECTION("write(2)")
+    {
+        options.buffer_size = 1000;
+        REQUIRE(to_json_fd(fd, records, options));
+        REQUIRE(read_whole(fp.get()) == expected);
+    }
+    SECTION("Memory mapped")
+    {
+        options.memory_mapped = true;
+        options.buffer_size = 10000;
+        options.pretty = true;
+        REQUIRE(to_json_fd(fd, records, options));
+        REQUIRE(read_whole(fp.get()) == expected_pretty);
+    }
+    SECTION("Memory mapped at an offset")
+    {
+        REQUIRE(to_json_fd(fd, 42));
+        options.memory_mapped = true;
+        REQUIRE(to_json_fd(fd, records, options));
+        REQUIRE(read_whole(fp.get()) == "42" + expected);
+    }
+    SECTION("Memory mapped over a longer file")
+    {
+        // Like write(2), the bytes past the output are kept
+        REQUIRE(to_json_fd(fd, records));
+        REQUIRE(::lseek(fd, 0, SEEK_SET) == 0);
+        options.memory_mapped = true;
+        REQUIRE(to_json_fd(fd, 42, options));
+        REQUIRE(::lseek(fd, 0, SEEK_CUR) == 2);
+        REQUIRE(read_whole(fp.get()) == "42" + expected.substr(2));
+    }
+    REQUIRE(!to_json_fd(-1, records, options));
+}
+#endif
@@ -0,0 +1,195 @@
+#include <staticjson/staticjson.hpp>
+
+#include "catch.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace staticjson;
+
+namespace plan_test
+{
+// Tag 0 is parsed by `ObjectHandler`, and tag 1 by a parse plan
+template <int Tag>
+struct Point
+{
+    int x = 0, y = 0;
+    double weight = 1;
+    std::string label;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("x", &x);
+        h->add_property("y", &y);
+        h->add_property("weight", &weight, Flags::Optional);
+        h->add_property("label", &label, Flags::Optional);
+        h->set_flags(Flags::DisallowUnknownKey);
+    }
+};
+
+template <int Tag>
+struct Shape
+{
+    std::string name;
+    unsigned id = 0;
+    std::int64_t big = 0;
+    std::uint64_t ubig = 0;
+    bool visible = false;
+    float scale = 1;
+    Point<Tag> origin;
+    std::vector<Point<Tag>> vertices;
+    std::unique_ptr<Point<Tag>> anchor;
+    std::vector<int> tags;
+    std::string secret = "hidden";
+    int computed = 42;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("name", &name);
+        h->add_property("id", &id);
+        h->add_property("big", &big, Flags::Optional);
+        h->add_property("ubig", &ubig, Flags::Optional);
+        h->add_property("visible", &visible, Flags::Optional);
+        h->add_property("scale", &scale, Flags::Optional);
+        h->add_property("origin", &origin, Flags::Optional);
+        h->add_property("vertices", &vertices, Flags::Optional);
+        h->add_property("anchor", &anchor, Flags::Optional);
+        h->add_property("tags", &tags, Flags::Optional);
+        h->add_property("secret", &secret, Flags::Optional | Flags::IgnoreRead);
+        h->add_property("computed", &computed, Flags::Optional | Flags::IgnoreWrite);
+    }
+};
+
+template <int Tag>
+struct Tree
+{
+    int value = 0;
+    std::unique_ptr<Tree> left, right;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("value", &value);
+        h->add_property("left", &left, Flags::Optional);
+        h->add_property("right", &right, Flags::Optional);
+        h->set_flags(Flags::AllowDuplicateKey);
+    }
+};
+}
+
+STATICJSON_DECLARE_PARSE_PLAN(plan_test::Point<1>)
+STATICJSON_DECLARE_PARSE_PLAN(plan_test::Shape<1>)
+STATICJSON_DECLARE_PARSE_PLAN(plan_test::Tree<1>)
+
+namespace
+{
+template <template <int> class T>
+void check_same(const std::string& json)
+{
+    CAPTURE(json);
+    T<0> expected;
+    T<1> actual;
+    ParseStatus expected_status, actual_status;
+    bool expected_success = from_json_string(json.c_str(), &expected, &expected_status);
+    bool actual_success = from_json_string(json.c_str(), &actual, &actual_status);
+    REQUIRE(expected_success == actual_success);
+    CHECK(expected_status.description() == actual_status.description());
+    if (!expected_success)
+        return;
+    CHECK(to_json_string(expected) == to_json_string(actual));
+    CHECK(to_pretty_json_string(expected) == to_pretty_json_string(actual));
+
+    Handler<T<1>> h(&actual);
+    CHECK(nonpublic::serialize_json_string(&h) == to_json_string(actual));
+}
+}
+
+TEST_CASE("Parse plans agree with ObjectHandler")
+{
+    using plan_test::Shape;
+    static_assert(std::is_base_of<PlanHandler<Shape<1>>, Handler<Shape<1>>>::value,
+                  "Shape<1> should be parsed by a plan");
+
+    check_same<Shape>(R"({"name": "square", "id": 7})");
+    check_same<Shape>(R"({"id": 7, "name": "tri", "big": -5000000000, "ubig": 18446744073709551615,
+        "visible": true, "scale": 0.5, "tags": [1, 2, 3],
+        "origin": {"x": 1, "y": -2, "weight": 2.5, "label": "o"},
+        "vertices": [{"x": 0, "y": 0}, {"x": 3, "y": 0, "weight": 7}, {"x": 0, "y": 4}],
+        "anchor": {"x": 9, "y": 9}})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "anchor": null, "vertices": []})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "unknown": {"a": [1, {"b": {}}], "name": 3},
+        "other": [[{}]]})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "secret": "ignored", "computed": 5})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "big": 12, "ubig": 12, "scale": 3})");
+
+    // Errors
+    check_same<Shape>(R"({"name": "n"})");
+    check_same<Shape>(R"({})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "name": "again"})");
+    check_same<Shape>(R"({"name": "n", "id": -1})");
+    check_same<Shape>(R"({"name": "n", "id": 4294967296})");
+    check_same<Shape>(R"({"name": "n", "id": 1.5})");
+    check_same<Shape>(R"({"name": 5, "id": 1})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "ubig": -1})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "big": 9223372036854775808})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "origin": {"x": 1}})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "origin": {"x": 1, "y": 2, "z": 3}})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "origin": {"x": 1, "y": "2"}})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "origin": [1, 2]})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "vertices": [{"x": 1, "y": 2}, {"x": true}]})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "anchor": {"y": 1}})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "tags": [1, "a"]})");
+    check_same<Shape>(R"([])");
+    check_same<Shape>(R"(12)");
+    check_same<Shape>(R"(null)");
+    check_same<Shape>(R"({"name": "n", "id": 1)");
+}
+
+TEST_CASE("Parse plans of recursive and nested types")
+{
+    using plan_test::Point;
+    using plan_test::Tree;
+
+    check_same<Tree>(R"({"value": 1})");
+    check_same<Tree>(R"({"value": 1, "left": {"value": 2, "right": {"value": 3}},
+        "right": {"value": 4, "value": 5, "left": null}})");
+    check_same<Tree>(R"({"value": 1, "left": {"value": 2, "left": {}}})");
+    check_same<Tree>(R"({"value": 1, "value": "x"})");
+
+    std::vector<Point<0>> expected;
+    std::vector<Point<1>> actual;
+    std::string json = R"([{"x": 1, "y": 2}, {"x": 3, "y": 4, "label": "b"}, {"y": 5, "x": 6}])";
+    REQUIRE(from_json_string(json.c_str(), &expected, nullptr));
+    REQUIRE(from_json_string(json.c_str(), &actual, nullptr));
+    CHECK(to_json_string(expected) == to_json_string(actual));
+
+    ParseStatus expected_status, actual_status;
+    json = R"([{"x": 1, "y": 2}, {"x": 3, "y": 4, "w": 1}])";
+    CHECK(!from_json_string(json.c_str(), &expected, &expected_status));
+    CHECK(!from_json_string(json.c_str(), &actual, &actual_status));
+    CHECK(expected_status.description() == actual_status.description());
+}
+
+TEST_CASE("Parse plans defer to ObjectHandler when limits are configured")
+{
+    using plan_test::Shape;
+
+    GlobalConfig::getInstance()->setMaxDepth(2);
+    check_same<Shape>(R"({"name": "n", "id": 1, "origin": {"x": 1, "y": 2}})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "vertices": [{"x": 1, "y": 2}]})");
+    GlobalConfig::getInstance()->unsetMaxDepthFlag();
+
+    GlobalConfig::getInstance()->setMaxLeaves(3);
+    check_same<Shape>(R"({"name": "n", "id": 1})");
+    check_same<Shape>(R"({"name": "n", "id": 1, "tags": [1, 2], "visible": true})");
+    GlobalConfig::getInstance()->unsetMaxLeavesFlag();
+}
+
+TEST_CASE("Parse plans export the same schema")
+{
+    plan_test::Shape<0> expected;
+    plan_test::Shape<1> actual;
+    CHECK(to_json_string(export_json_schema(&expected))
+          == to_json_string(export_json_schema(&actual)));
+}
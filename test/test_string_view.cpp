@@ -0,0 +1,71 @@
+#include <staticjson/staticjson.hpp>
+#include <staticjson/string_view_support.hpp>
+
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace staticjson;
+
+namespace
+{
+struct Record
+{
+    std::string_view name;
+    StringSlice id;
+    std::vector<std::string_view> tags;
+
+    void staticjson_init(ObjectHandler* h)
+    {
+        h->add_property("name", &name);
+        h->add_property("id", &id);
+        h->add_property("tags", &tags, Flags::Optional);
+    }
+};
+}
+
+TEST_CASE("View fields point into the input of in situ parsing")
+{
+    std::string input = R"({"name": "plain", "id": "with \"escapes\"", "tags": ["a", "b\n"]})";
+    Record r;
+    REQUIRE(from_json_insitu(&input[0], &r, nullptr));
+
+    const char* begin = input.data();
+    const char* end = begin + input.size();
+    CHECK(r.name == "plain");
+    CHECK(r.name.data() >= begin);
+    CHECK(r.name.data() < end);
+    CHECK(std::string(r.id.data, r.id.size) == "with \"escapes\"");
+    CHECK(r.id.data >= begin);
+    CHECK(r.id.data < end);
+    REQUIRE(r.tags.size() == 2);
+    CHECK(r.tags[1] == "b\n");
+    CHECK(to_json_string(r) == R"({"id":"with \"escapes\"","name":"plain","tags":["a","b\n"]})");
+}
+
+TEST_CASE("View fields copy into a string arena otherwise")
+{
+    const char* input = R"({"name": "copied", "id": "x"})";
+    Record r;
+    ParseStatus status;
+    CHECK(!from_json_string(input, &r, &status));
+    CHECK(status.has_error());
+
+    StringArena arena;
+    {
+        StringArenaScope scope(&arena);
+        REQUIRE(from_json_string(input, &r, nullptr));
+    }
+    CHECK(r.name == "copied");
+    CHECK(std::string(r.id.data, r.id.size) == "x");
+    CHECK(arena.capacity() > 0);
+
+    size_t capacity = arena.capacity();
+    arena.clear();
+    {
+        StringArenaScope scope(&arena);
+        REQUIRE(from_json_string(input, &r, nullptr));
+    }
+    CHECK(arena.capacity() == capacity);
+}